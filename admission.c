@@ -0,0 +1,179 @@
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "admission.h"
+
+#define HOST_BUCKETS 256
+
+typedef struct queued_item {
+	void *item;
+	struct queued_item *next;
+} queued_item;
+
+typedef struct admission_host {
+	char *name;
+	int in_flight;
+	queued_item *head, *tail;
+	struct admission_host *hash_next;
+	// ring of hosts with queued items
+	struct admission_host *prev, *next;
+	bool in_ring;
+} admission_host;
+
+struct zblock_admission {
+	int max_total;
+	int max_per_host;
+	int in_flight;
+	size_t pending;
+	admission_host *buckets[HOST_BUCKETS];
+	admission_host *cursor; // the host that gets the next turn
+};
+
+// FNV-1a
+static uint32_t hash_host(const char *host) {
+	uint32_t hash = 2166136261u;
+	while (*host) {
+		hash ^= (unsigned char) *host++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static admission_host *find_host(zblock_admission *admission, const char *host, bool create) {
+	admission_host **bucket = &admission->buckets[hash_host(host) % HOST_BUCKETS];
+	for (admission_host *h = *bucket; h; h = h->hash_next) {
+		if (!strcmp(h->name, host)) return h;
+	}
+	if (!create) return NULL;
+
+	admission_host *h = calloc(1, sizeof(*h));
+	if (!h) return NULL;
+	h->name = strdup(host);
+	if (!h->name) {
+		free(h);
+		return NULL;
+	}
+	h->hash_next = *bucket;
+	*bucket = h;
+	return h;
+}
+
+static void ring_insert(zblock_admission *admission, admission_host *h) {
+	if (h->in_ring) return;
+	h->in_ring = true;
+	if (!admission->cursor) {
+		h->prev = h->next = h;
+		admission->cursor = h;
+	} else {
+		// join at the back so hosts that were already waiting go first
+		h->next = admission->cursor;
+		h->prev = admission->cursor->prev;
+		h->prev->next = h;
+		admission->cursor->prev = h;
+	}
+}
+
+static void ring_remove(zblock_admission *admission, admission_host *h) {
+	if (!h->in_ring) return;
+	h->in_ring = false;
+	if (h->next == h) {
+		admission->cursor = NULL;
+	} else {
+		h->prev->next = h->next;
+		h->next->prev = h->prev;
+		if (admission->cursor == h) admission->cursor = h->next;
+	}
+	h->prev = h->next = NULL;
+}
+
+// creates an empty admission queue. returns NULL if out of memory.
+zblock_admission *zblock_admission_new(int max_total, int max_per_host) {
+	zblock_admission *admission = calloc(1, sizeof(*admission));
+	if (!admission) return NULL;
+	admission->max_total = max_total > 0 ? max_total : 1;
+	admission->max_per_host = max_per_host > 0 ? max_per_host : 1;
+	return admission;
+}
+
+// frees the queue. anything still queued is not freed.
+void zblock_admission_delete(zblock_admission *admission) {
+	if (!admission) return;
+	for (size_t i = 0; i < HOST_BUCKETS; ++i) {
+		admission_host *h = admission->buckets[i];
+		while (h) {
+			admission_host *next = h->hash_next;
+			for (queued_item *q = h->head; q;) {
+				queued_item *next_q = q->next;
+				free(q);
+				q = next_q;
+			}
+			free(h->name);
+			free(h);
+			h = next;
+		}
+	}
+	free(admission);
+}
+
+// queues an item to be started once its host has room. returns false if out of memory.
+bool zblock_admission_push(zblock_admission *admission, const char *host, void *item) {
+	admission_host *h = find_host(admission, host ? host : "", true);
+	if (!h) return false;
+
+	queued_item *q = malloc(sizeof(*q));
+	if (!q) return false;
+	*q = (queued_item) { .item = item, .next = NULL };
+	if (h->tail) h->tail->next = q;
+	else h->head = q;
+	h->tail = q;
+
+	++admission->pending;
+	ring_insert(admission, h);
+	return true;
+}
+
+/* Returns the next item that is allowed to start and counts it as in flight.
+ * Returns NULL if nothing can start right now. */
+void *zblock_admission_next(zblock_admission *admission) {
+	if (admission->in_flight >= admission->max_total || !admission->cursor) return NULL;
+
+	// go around the ring once looking for a host that has room
+	admission_host *start = admission->cursor, *h = start;
+	do {
+		if (h->in_flight < admission->max_per_host) {
+			queued_item *q = h->head;
+			h->head = q->next;
+			if (!h->head) h->tail = NULL;
+			void *item = q->item;
+			free(q);
+
+			++h->in_flight;
+			++admission->in_flight;
+			--admission->pending;
+			// the next host gets the next turn
+			admission->cursor = h->next;
+			if (!h->head) ring_remove(admission, h);
+			return item;
+		}
+		h = h->next;
+	} while (h != start);
+
+	return NULL;
+}
+
+// marks a transfer to the host as finished, making room for another
+void zblock_admission_done(zblock_admission *admission, const char *host) {
+	admission_host *h = find_host(admission, host ? host : "", false);
+	if (!h || !h->in_flight) return;
+	--h->in_flight;
+	--admission->in_flight;
+}
+
+// returns the number of items that haven't been started yet
+size_t zblock_admission_pending(zblock_admission *admission) {
+	return admission->pending;
+}
@@ -0,0 +1,31 @@
+#ifndef ZBLOCK_ADMISSION_H
+#define ZBLOCK_ADMISSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Decides which queued transfers are allowed to start.
+ * At most max_total are in flight at once and at most max_per_host to the same host,
+ * and hosts take turns so one with lots of feeds can't hold up the rest. */
+typedef struct zblock_admission zblock_admission;
+
+// creates an empty admission queue. returns NULL if out of memory.
+zblock_admission *zblock_admission_new(int max_total, int max_per_host);
+
+// frees the queue. anything still queued is not freed.
+void zblock_admission_delete(zblock_admission *admission);
+
+// queues an item to be started once its host has room. returns false if out of memory.
+bool zblock_admission_push(zblock_admission *admission, const char *host, void *item);
+
+/* Returns the next item that is allowed to start and counts it as in flight.
+ * Returns NULL if nothing can start right now. */
+void *zblock_admission_next(zblock_admission *admission);
+
+// marks a transfer to the host as finished, making room for another
+void zblock_admission_done(zblock_admission *admission, const char *host);
+
+// returns the number of items that haven't been started yet
+size_t zblock_admission_pending(zblock_admission *admission);
+
+#endif
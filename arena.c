@@ -17,56 +17,108 @@
 
 // The arena region itself is allocated after the contents of the struct.
 struct Arena {
-	size_t size;
-	size_t tmp_size;
+	alignas(MEM_ALIGNMENT) size_t size; // keeps the region after the struct aligned
 	void *last_block;
+	size_t last_size; // size that was asked for when last_block was allocated
 	void *next_block;
 	Arena *next_region;
+	// only used in the first region
+	Arena *tail; // region that allocations are currently made in
+	struct tmp_state *tmp_state; // the last temporary buffer
+	size_t used;
+	size_t padding;
+	size_t high_water;
 	bool dynamic;
 };
 
+// Saved at the beginning of every temporary buffer. The buffer starts where this is stored.
+struct tmp_state {
+	struct tmp_state *prev;
+	Arena *region;
+	void *last_block;
+	size_t last_size;
+	size_t used;
+	size_t padding;
+};
+
 // Get the start address of the arena
 static inline void *Arena_start(Arena *arena) {
 	return arena + 1;
 }
 
-// Allocates a fixed-size arena. Accepts the size of the arena in bytes.
-Arena *Arena_new(size_t size) {
+static Arena *Arena_create(size_t size, bool dynamic) {
 	Arena *new_arena = malloc(sizeof(Arena) + size);
+	if (new_arena == NULL) return NULL;
 
 	*new_arena = (Arena) {
 		.size = size,
-		.tmp_size = 0,
 		.last_block = NULL,
+		.last_size = 0,
 		.next_block = Arena_start(new_arena),
 		.next_region = NULL,
-		.dynamic = false
+		.tail = new_arena,
+		.tmp_state = NULL,
+		.used = 0,
+		.padding = 0,
+		.high_water = 0,
+		.dynamic = dynamic
 	};
 
 	return new_arena;
 }
 
+// Allocates a fixed-size arena. Accepts the size of the arena in bytes.
+Arena *Arena_new(size_t size) {
+	return Arena_create(size, false);
+}
+
 /* Allocates a dynamically-sized arena. Accepts the initial size of the arena in bytes.
- * If there is not enough space in the arena for an allocation, a new region will be created. */
+ * If there is not enough space in the arena for an allocation, a new region will be created.
+ * Every new region is twice the size of the last one. */
 Arena *Arena_new_dynamic(size_t size) {
-	Arena *new_arena = malloc(sizeof(Arena) + size);
-
-	*new_arena = (Arena) {
-		.size = size,
-		.tmp_size = 0,
-		.last_block = NULL,
-		.next_block = Arena_start(new_arena),
-		.next_region = NULL,
-		.dynamic = true
-	};
-
-	return new_arena;
+	return Arena_create(size, true);
 }
 
 // Frees the entire arena from memory.
 void Arena_delete(Arena *arena) {
-	if (arena->next_region != NULL) Arena_delete(arena->next_region);
-	free(arena);
+	while (arena != NULL) {
+		Arena *next_region = arena->next_region;
+		free(arena);
+		arena = next_region;
+	}
+}
+
+// empties every region from this one onwards
+static void reset_regions(Arena *region) {
+	for (; region != NULL; region = region->next_region) {
+		region->last_block = NULL;
+		region->last_size = 0;
+		region->next_block = Arena_start(region);
+	}
+}
+
+/* Deallocates everything in the arena so it can be used again.
+ * Any extra regions of a dynamic arena are kept, so reusing it won't allocate until it grows past them. */
+void Arena_reset(Arena *arena) {
+	reset_regions(arena);
+	arena->tail = arena;
+	arena->tmp_state = NULL;
+	arena->used = 0;
+	arena->padding = 0;
+}
+
+// Reports how much of the arena is in use. The high-water mark is kept through resets.
+ArenaStats Arena_stats(const Arena *arena) {
+	ArenaStats stats = {
+		.used = arena->used,
+		.high_water = arena->high_water,
+		.padding = arena->padding
+	};
+	for (const Arena *region = arena; region != NULL; region = region->next_region) {
+		stats.capacity += region->size;
+		++stats.regions;
+	}
+	return stats;
 }
 
 #ifdef ENABLE_DIAG
@@ -79,42 +131,57 @@ static void print_diagnostic(Arena *arena, size_t size) {
 }
 #endif
 
-static inline void *Arena_init_block(Arena *arena, size_t size) {
-	size_t blksize = align(size);
-	arena->tmp_size += blksize;
-	void *new_block = arena->next_block;
-	arena->last_block = new_block;
-	arena->next_block += blksize;
+static inline bool region_fits(Arena *region, void *block, size_t size) {
+	return block + align(size) <= Arena_start(region) + region->size;
+}
+
+// keeps the stats in the first region up to date when a block changes size
+static inline void count_block(Arena *arena, size_t old_size, size_t new_size) {
+	arena->used += align(new_size) - align(old_size);
+	arena->padding += (align(new_size) - new_size) - (align(old_size) - old_size);
+	if (arena->used > arena->high_water) arena->high_water = arena->used;
+}
+
+static inline void *Arena_init_block(Arena *arena, Arena *region, size_t size) {
+	void *new_block = region->next_block;
+	region->last_block = new_block;
+	region->last_size = size;
+	region->next_block += align(size);
+	count_block(arena, 0, size);
 	return new_block;
 }
 
 // Will return a null pointer if you've tried allocating too much memory.
 void *Arena_alloc(Arena *arena, size_t size) {
-	if (arena->next_block + align(size) > Arena_start(arena) + arena->size) {
-		if (arena->dynamic) {
-			if (arena->next_region == NULL) {
-				// If the size is too large for a region, make a special region for only that block.
-				size_t region_size = size > arena->size ? size : arena->size;
-				arena->next_region = Arena_new_dynamic(region_size);
-				return Arena_init_block(arena->next_region, size);
-			} else {
-				return Arena_alloc(arena->next_region, size);
-			}
-		} else {
+	Arena *region = arena->tail;
+	while (!region_fits(region, region->next_block, size)) {
+		if (!arena->dynamic) {
 #ifdef ENABLE_DIAG
 			fprintf(stderr, "Allocation too large. You've attempted to allocate a block of memory past the end of the arena.\n");
-			print_diagnostic(arena, size);
+			print_diagnostic(region, size);
 #endif
 			return NULL;
 		}
-	} else {
-		return Arena_init_block(arena, size);
+
+		// Regions kept by a reset or rewind get used again before making a new one.
+		if (region->next_region == NULL) {
+			// Grow geometrically so large builders only need a handful of regions.
+			size_t region_size = region->size * 2;
+			if (region_size < align(size)) region_size = align(size);
+			region->next_region = Arena_create(region_size, true);
+			if (region->next_region == NULL) return NULL;
+		}
+		region = region->next_region;
+		arena->tail = region;
 	}
+
+	return Arena_init_block(arena, region, size);
 }
 
 // Identical to Arena_alloc but it zeros your memory
 void *Arena_allocz(Arena *arena, size_t size) {
-	return memset(Arena_alloc(arena, size), 0, size);
+	void *new_block = Arena_alloc(arena, size);
+	return new_block == NULL ? NULL : memset(new_block, 0, size);
 }
 
 /* Copy a block of memory into an arena.
@@ -134,74 +201,72 @@ void *Arena_copy(Arena *arena, const void *src, size_t size) {
  * Be careful with this! A null pointer will be returned upon error.
  * Using this with memory outside of the arena is undefined behavior. */
 void *Arena_realloc(Arena *arena, void *ptr, size_t size) {
-	if (ptr == arena->last_block) {
-		if (arena->last_block + align(size) > Arena_start(arena) + arena->size) {
-			if (arena->dynamic) {
-				return Arena_copy(arena, ptr, size);
-			} else {
+	if (ptr == NULL) return Arena_alloc(arena, size);
+	Arena *region = arena->tail;
+	if (ptr != region->last_block) return Arena_copy(arena, ptr, size);
+
+	if (region_fits(region, ptr, size)) {
+		region->next_block = ptr + align(size);
+		count_block(arena, region->last_size, size);
+		region->last_size = size;
+		return ptr;
+	}
+
+	if (!arena->dynamic) {
 #ifdef ENABLE_DIAG
-				fprintf(stderr, "Allocation too large. You've attempted to allocate a block of memory past the end of the arena.\n");
-				print_diagnostic(arena, size - (arena->next_block - arena->last_block));
+		fprintf(stderr, "Allocation too large. You've attempted to allocate a block of memory past the end of the arena.\n");
+		print_diagnostic(region, size - (region->next_block - region->last_block));
 #endif
-				return NULL;
-			}
-		} else {
-			arena->next_block = arena->last_block + align(size);
-			return ptr;
-		}
-	} else {
-		return Arena_copy(arena, ptr, size);
+		return NULL;
 	}
+
+	// It has to move to the next region, and only the old block is worth copying.
+	size_t old_size = region->next_block - ptr;
+	void *new_block = Arena_alloc(arena, size);
+	if (new_block != NULL) memcpy(new_block, ptr, old_size < size ? old_size : size);
+	return new_block;
 }
 
 /* Marks the beginning of a temporary buffer that can be deallocated at any time.
  * The state of the last one is saved in case you have multiple. */
 void Arena_tmp_begin(Arena *arena) {
-	size_t tmp_size = arena->tmp_size;
-	void *last_block = arena->last_block;
-	arena->tmp_size = 0;
+	Arena *region = arena->tail;
+	void *last_block = region->last_block;
+	size_t last_size = region->last_size;
+	size_t used = arena->used;
+	size_t padding = arena->padding;
 
-	void *state = Arena_alloc(arena, sizeof(size_t) + sizeof(void*));
+	struct tmp_state *state = Arena_alloc(arena, sizeof(*state));
 	if (state == NULL) return;
-	*(size_t*) state = tmp_size;
-	*(void**) (state + sizeof(void*)) = last_block;
-}
-
-static void tmp_rewind(Arena *arena, bool *complete) {
-	void *stateloc = arena->next_block - arena->tmp_size;
-	if (arena->next_region != NULL) {
-		tmp_rewind(arena->next_region, complete);
-		arena->next_region = NULL;
-	}
-
-	if (*complete) return;
-
-	if (stateloc == Arena_start(arena)) {
-		Arena_delete(arena);
-	} else {
-		arena->tmp_size = *(size_t*) stateloc;
-		arena->last_block = *(void**) (stateloc + sizeof(size_t));
-		arena->next_block = stateloc;
-		*complete = true;
-	}
+	*state = (struct tmp_state) {
+		.prev = arena->tmp_state,
+		.region = arena->tail,
+		// A new region had nothing in it before.
+		.last_block = arena->tail == region ? last_block : NULL,
+		.last_size = arena->tail == region ? last_size : 0,
+		.used = used,
+		.padding = padding
+	};
+	arena->tmp_state = state;
 }
 
 /* Deallocates the last temporary buffer. If there is none,
  * the entire arena will be deallocated. */
 void Arena_tmp_rewind(Arena *arena) {
-	bool complete = false;
-
-	if (arena->next_region != NULL) {
-		tmp_rewind(arena->next_region, &complete);
-		arena->next_region = NULL;
+	struct tmp_state *state = arena->tmp_state;
+	if (state == NULL) {
+		Arena_reset(arena);
+		return;
 	}
 
-	if (!complete) {
-		void *stateloc = arena->next_block - arena->tmp_size;
-		if (stateloc != Arena_start(arena)) {
-			arena->tmp_size = *(size_t*) stateloc;
-			arena->last_block = *(void**) (stateloc + sizeof(size_t));
-		}
-		arena->next_block = stateloc;
-	}
+	// Everything after the state is part of the buffer, including any regions made since.
+	Arena *region = state->region;
+	reset_regions(region->next_region);
+	region->next_block = state;
+	region->last_block = state->last_block;
+	region->last_size = state->last_size;
+	arena->tail = region;
+	arena->tmp_state = state->prev;
+	arena->used = state->used;
+	arena->padding = state->padding;
 }
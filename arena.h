@@ -5,22 +5,40 @@
 #ifndef ARENA_H
 #define ARENA_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef struct Arena Arena;
 
+typedef struct {
+	size_t used; // bytes handed out, including padding
+	size_t high_water; // most bytes that have ever been in use at once
+	size_t capacity; // bytes in every region
+	size_t regions;
+	size_t padding; // bytes lost to rounding allocations up to the alignment
+} ArenaStats;
+
 // Allocates a fixed-size arena. Accepts the size of the arena in bytes.
 Arena *Arena_new(size_t size);
 
 /* Allocates a dynamically-sized arena. Accepts the initial size of the arena in bytes.
- * If there is not enough space in the arena for an allocation, a new region will be created. */
+ * If there is not enough space in the arena for an allocation, a new region will be created.
+ * Every new region is twice the size of the last one. */
 Arena *Arena_new_dynamic(size_t size);
 
 // Frees the entire arena from memory.
 void Arena_delete(Arena *arena);
 
+/* Deallocates everything in the arena so it can be used again.
+ * Any extra regions of a dynamic arena are kept, so reusing it won't allocate until it grows past them. */
+void Arena_reset(Arena *arena);
+
+// Reports how much of the arena is in use. The high-water mark is kept through resets.
+ArenaStats Arena_stats(const Arena *arena);
+
 // Will return a null pointer if you've tried allocating too much memory.
 void *Arena_alloc(Arena *arena, size_t size);
 
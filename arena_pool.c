@@ -0,0 +1,76 @@
+#include <assert.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "arena.h"
+#include "arena_pool.h"
+
+static const char *ZBLOCK_ARENA_POOL_ERRORS[] = {
+	"OK",
+	"Out of memory"
+};
+static_assert(sizeof(ZBLOCK_ARENA_POOL_ERRORS) / sizeof(*ZBLOCK_ARENA_POOL_ERRORS) == ZBLOCK_ARENA_POOL_ERRORCOUNT, "Not all arena pool errors implemented");
+
+static struct {
+	Arena *idle[ZBLOCK_ARENA_POOL_MAX]; // stack of arenas that aren't checked out
+	int nidle;
+	pthread_mutex_t lock;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+// allocates count arenas up front so the first interactions don't have to
+zblock_arena_pool_err zblock_arena_pool_init(int count) {
+	if (count > ZBLOCK_ARENA_POOL_MAX) count = ZBLOCK_ARENA_POOL_MAX;
+
+	pthread_mutex_lock(&pool.lock);
+	while (pool.nidle < count) {
+		Arena *arena = Arena_new_dynamic(ZBLOCK_ARENA_POOL_ARENA_SIZE);
+		if (!arena) {
+			pthread_mutex_unlock(&pool.lock);
+			return ZBLOCK_ARENA_POOL_NOMEM;
+		}
+		pool.idle[pool.nidle++] = arena;
+	}
+	pthread_mutex_unlock(&pool.lock);
+
+	return ZBLOCK_ARENA_POOL_OK;
+}
+
+/* Takes an empty arena out of the pool, allocating a new one only if none are left.
+ * Returns NULL if one couldn't be allocated. */
+Arena *zblock_arena_pool_checkout(void) {
+	pthread_mutex_lock(&pool.lock);
+	Arena *arena = pool.nidle ? pool.idle[--pool.nidle] : NULL;
+	pthread_mutex_unlock(&pool.lock);
+
+	return arena ? arena : Arena_new_dynamic(ZBLOCK_ARENA_POOL_ARENA_SIZE);
+}
+
+// empties an arena and returns it to the pool. everything allocated in it is gone.
+void zblock_arena_pool_checkin(Arena *arena) {
+	if (!arena) return;
+	Arena_reset(arena);
+
+	pthread_mutex_lock(&pool.lock);
+	if (pool.nidle < ZBLOCK_ARENA_POOL_MAX) {
+		pool.idle[pool.nidle++] = arena;
+		arena = NULL;
+	}
+	pthread_mutex_unlock(&pool.lock);
+
+	// the pool is full, so this one was extra
+	if (arena) Arena_delete(arena);
+}
+
+// frees every arena in the pool. anything that is checked out has to be checked in first.
+void zblock_arena_pool_destroy(void) {
+	pthread_mutex_lock(&pool.lock);
+	while (pool.nidle) Arena_delete(pool.idle[--pool.nidle]);
+	pthread_mutex_unlock(&pool.lock);
+}
+
+// returns a string about the result of an arena pool function
+const char *zblock_arena_pool_strerror(zblock_arena_pool_err error) {
+	return error < 0 || error >= ZBLOCK_ARENA_POOL_ERRORCOUNT ? "Unspecified error" : ZBLOCK_ARENA_POOL_ERRORS[error];
+}
@@ -0,0 +1,35 @@
+#ifndef ZBLOCK_ARENA_POOL_H
+#define ZBLOCK_ARENA_POOL_H
+
+#include "arena.h"
+
+// starting size of every pooled arena (in bytes). they grow if something needs more.
+// a full /list page with its job and the feeds copied out of the cache peaks at about 6.1 KiB according to bench/arena_bench.
+#define ZBLOCK_ARENA_POOL_ARENA_SIZE 8192
+
+// most arenas kept around for reuse. more than this can be checked out, but the extras are freed when they come back.
+#define ZBLOCK_ARENA_POOL_MAX 32
+
+typedef enum {
+	ZBLOCK_ARENA_POOL_OK,
+	ZBLOCK_ARENA_POOL_NOMEM,
+	ZBLOCK_ARENA_POOL_ERRORCOUNT
+} zblock_arena_pool_err;
+
+// allocates count arenas up front so the first interactions don't have to
+zblock_arena_pool_err zblock_arena_pool_init(int count);
+
+/* Takes an empty arena out of the pool, allocating a new one only if none are left.
+ * Returns NULL if one couldn't be allocated. */
+Arena *zblock_arena_pool_checkout(void);
+
+// empties an arena and returns it to the pool. everything allocated in it is gone.
+void zblock_arena_pool_checkin(Arena *arena);
+
+// frees every arena in the pool. anything that is checked out has to be checked in first.
+void zblock_arena_pool_destroy(void);
+
+// returns a string about the result of an arena pool function
+const char *zblock_arena_pool_strerror(zblock_arena_pool_err error);
+
+#endif
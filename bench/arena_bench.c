@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+#include "arena_pool.h"
+
+/* The allocations list_data_create makes for a full page, in order, on top of the interaction job.
+ * The struct sizes are what concord's structs come out to on x86_64. */
+static const size_t LIST_PAGE_ALLOCS[] = {
+	72,   // struct interaction_job
+	216,  // interaction token
+	56,   // button custom_id argument
+	320,  // five feed urls copied out of the list cache
+	200,  // five feed titles
+	96,   // struct discord_interaction_callback_data
+	16,   // struct discord_components
+	168,  // action row
+	16,   // struct discord_components
+	336,  // two buttons
+	88,   // back emoji
+	88,   // next emoji
+	48,   // back button id
+	48,   // next button id
+	16,   // struct discord_embeds
+	264,  // struct discord_embed
+	28,   // embed title
+	4096  // embed description
+};
+#define LIST_PAGE_NALLOCS (sizeof(LIST_PAGE_ALLOCS) / sizeof(*LIST_PAGE_ALLOCS))
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// touches every block so none of the allocations can be skipped
+static volatile unsigned char sink;
+static void touch(void *block, size_t size) {
+	memset(block, 1, size);
+	sink += ((unsigned char *) block)[size - 1];
+}
+
+// builds a list page out of a pooled arena, the way interactions are answered now
+static void list_page_arena(void) {
+	Arena *arena = zblock_arena_pool_checkout();
+	for (size_t i = 0; i < LIST_PAGE_NALLOCS; ++i) touch(Arena_alloc(arena, LIST_PAGE_ALLOCS[i]), LIST_PAGE_ALLOCS[i]);
+	zblock_arena_pool_checkin(arena);
+}
+
+// builds a list page with a fresh arena, the way list_data_create used to
+static void list_page_fresh_arena(void) {
+	Arena *arena = Arena_new(ZBLOCK_ARENA_POOL_ARENA_SIZE);
+	for (size_t i = 0; i < LIST_PAGE_NALLOCS; ++i) touch(Arena_alloc(arena, LIST_PAGE_ALLOCS[i]), LIST_PAGE_ALLOCS[i]);
+	Arena_delete(arena);
+}
+
+// builds a list page with a malloc for every block
+static void list_page_malloc(void) {
+	void *blocks[LIST_PAGE_NALLOCS];
+	for (size_t i = 0; i < LIST_PAGE_NALLOCS; ++i) {
+		blocks[i] = malloc(LIST_PAGE_ALLOCS[i]);
+		touch(blocks[i], LIST_PAGE_ALLOCS[i]);
+	}
+	for (size_t i = 0; i < LIST_PAGE_NALLOCS; ++i) free(blocks[i]);
+}
+
+// grows a message one line at a time, like a description that isn't capped
+#define GROW_LINES 256
+#define GROW_LINE_SIZE 96
+
+static void grow_arena(Arena *arena) {
+	char *buf = NULL;
+	size_t len = 0;
+	for (int i = 0; i < GROW_LINES; ++i) {
+		buf = Arena_realloc(arena, buf, len + GROW_LINE_SIZE);
+		touch(buf + len, GROW_LINE_SIZE);
+		len += GROW_LINE_SIZE;
+	}
+	Arena_reset(arena);
+}
+
+static void grow_malloc(void) {
+	char *buf = NULL;
+	size_t len = 0;
+	for (int i = 0; i < GROW_LINES; ++i) {
+		buf = realloc(buf, len + GROW_LINE_SIZE);
+		touch(buf + len, GROW_LINE_SIZE);
+		len += GROW_LINE_SIZE;
+	}
+	free(buf);
+}
+
+// scratch space that is thrown away right after, like formatting a date for one line
+#define SCRATCH_ALLOCS 8
+
+static void scratch_arena(Arena *arena) {
+	Arena_tmp_begin(arena);
+	for (int i = 0; i < SCRATCH_ALLOCS; ++i) touch(Arena_alloc(arena, 32 + i * 16), 32 + i * 16);
+	Arena_tmp_rewind(arena);
+}
+
+static void scratch_malloc(void) {
+	void *blocks[SCRATCH_ALLOCS];
+	for (int i = 0; i < SCRATCH_ALLOCS; ++i) {
+		blocks[i] = malloc(32 + i * 16);
+		touch(blocks[i], 32 + i * 16);
+	}
+	for (int i = 0; i < SCRATCH_ALLOCS; ++i) free(blocks[i]);
+}
+
+static Arena *bench_arena;
+static void grow_arena_bench(void) { grow_arena(bench_arena); }
+static void scratch_arena_bench(void) { scratch_arena(bench_arena); }
+
+// returns nanoseconds per call
+static double bench(void (*func)(void), int rounds) {
+	double start = now();
+	for (int i = 0; i < rounds; ++i) func();
+	return (now() - start) * 1e9 / rounds;
+}
+
+static void print_stats(const char *name, const Arena *arena) {
+	ArenaStats stats = Arena_stats(arena);
+	printf("%-12s used %6zu  high water %6zu  capacity %6zu  regions %2zu  padding %4zu\n",
+		name, stats.used, stats.high_water, stats.capacity, stats.regions, stats.padding);
+}
+
+int main(int argc, char *argv[]) {
+	int rounds = argc > 1 ? atoi(argv[1]) : 200000;
+	if (rounds <= 0) rounds = 200000;
+
+	// how much of a pooled arena each pattern actually needs, to size ZBLOCK_ARENA_POOL_ARENA_SIZE with
+	Arena *arena = Arena_new_dynamic(ZBLOCK_ARENA_POOL_ARENA_SIZE);
+	for (size_t i = 0; i < LIST_PAGE_NALLOCS; ++i) Arena_alloc(arena, LIST_PAGE_ALLOCS[i]);
+	print_stats("list page", arena);
+	Arena_delete(arena);
+	arena = Arena_new_dynamic(ZBLOCK_ARENA_POOL_ARENA_SIZE);
+	char *buf = NULL;
+	for (int i = 0; i < GROW_LINES; ++i) buf = Arena_realloc(arena, buf, (i + 1) * GROW_LINE_SIZE);
+	print_stats("grow", arena);
+	Arena_delete(arena);
+
+	zblock_arena_pool_init(1);
+	bench_arena = Arena_new_dynamic(ZBLOCK_ARENA_POOL_ARENA_SIZE);
+	printf("list page:  pooled arena %7.1f ns  fresh arena %7.1f ns  malloc/free %7.1f ns\n",
+		bench(&list_page_arena, rounds), bench(&list_page_fresh_arena, rounds), bench(&list_page_malloc, rounds));
+	printf("grow:       Arena_realloc %7.1f ns  realloc %7.1f ns\n",
+		bench(&grow_arena_bench, rounds / 10), bench(&grow_malloc, rounds / 10));
+	printf("scratch:    tmp_begin/rewind %7.1f ns  malloc/free %7.1f ns\n",
+		bench(&scratch_arena_bench, rounds), bench(&scratch_malloc, rounds));
+	Arena_delete(bench_arena);
+	zblock_arena_pool_destroy();
+
+	return 0;
+}
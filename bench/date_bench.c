@@ -0,0 +1,84 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "date.h"
+
+// dates as they show up in real feeds
+static const char *CORPUS[] = {
+	"Tue, 03 Jun 2008 11:05:30 GMT",
+	"Mon, 15 Jan 2024 08:30:00 +0000",
+	"Wed, 21 Feb 2024 17:45:12 -0500",
+	"Fri, 01 Mar 2024 00:00:00 EST",
+	"Sat, 09 Dec 2023 23:59:59 PST",
+	"Sun, 5 May 2024 14:03:07 +0200",
+	"Thu, 11 Apr 2024 06:15:00 UT",
+	"Thu, 11 Apr 2024 06:15:00 Z",
+	"Mon, 29 Jul 2024 12:00:00 +05:30",
+	"Tuesday, 03 June 2008 11:05:30 GMT",
+	"03 Jun 2008 11:05:30 GMT",
+	"Tue, 03 Jun 08 11:05:30 GMT",
+	"Tue, 03 Jun 2008 11:05 GMT",
+	"Tue, 03 Jun 2008 11:05:30",
+	"2008-06-03T11:05:30Z",
+	"2024-01-15T08:30:00+00:00",
+	"2024-02-21T17:45:12.123-05:00",
+	"2024-03-01T00:00:00.000000Z",
+	"2024-05-05T14:03:07+0200",
+	"2024-04-11",
+	"2024-07-29 12:00:00",
+	"Never"
+};
+#define CORPUS_SIZE (sizeof(CORPUS) / sizeof(*CORPUS))
+
+// the parser zblock used before date.c
+static time_t strptime_parse(const char *s) {
+	struct tm tm = {0};
+
+	// time format with e.g. +0000
+	if (!strptime(s, "%a, %d %b %Y %T %z", &tm)) { // try the other time format with timezone
+		if(!strptime(s, "%a, %d %b %Y %T %Z", &tm)) return 0; // invalid time
+	}
+
+	return timegm(&tm);
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// returns nanoseconds per date, sink keeps the calls from being optimized out
+static double bench(time_t (*parse)(const char *), int rounds, volatile time_t *sink) {
+	double start = now();
+	for (int i = 0; i < rounds; ++i) {
+		for (size_t j = 0; j < CORPUS_SIZE; ++j) *sink += parse(CORPUS[j]);
+	}
+	return (now() - start) * 1e9 / ((double) rounds * CORPUS_SIZE);
+}
+
+int main(int argc, char *argv[]) {
+	int rounds = argc > 1 ? atoi(argv[1]) : 100000;
+	if (rounds <= 0) rounds = 100000;
+
+	// the old parser dropped the timezone offset and read two digit years as the first century, so differences are expected there
+	int strptime_parsed = 0, date_parsed = 0;
+	for (size_t i = 0; i < CORPUS_SIZE; ++i) {
+		time_t old = strptime_parse(CORPUS[i]), new = zblock_date_parse(CORPUS[i]);
+		strptime_parsed += old != 0;
+		date_parsed += new != 0;
+		if (old != new) printf("differs: \"%s\" strptime=%lld zblock_date_parse=%lld\n", CORPUS[i], (long long) old, (long long) new);
+	}
+	printf("parsed: strptime %d/%zu, zblock_date_parse %d/%zu\n", strptime_parsed, CORPUS_SIZE, date_parsed, CORPUS_SIZE);
+
+	volatile time_t sink = 0;
+	double strptime_ns = bench(&strptime_parse, rounds, &sink);
+	double date_ns = bench(&zblock_date_parse, rounds, &sink);
+	printf("strptime:          %8.1f ns/date\n", strptime_ns);
+	printf("zblock_date_parse: %8.1f ns/date\n", date_ns);
+	printf("speedup:           %8.1fx\n", strptime_ns / date_ns);
+
+	return 0;
+}
@@ -0,0 +1,488 @@
+// feed_info.c is included whole so every statement can be explained by the name it's prepared under
+#include "../feed_info.c"
+
+#include <getopt.h>
+#include <stdarg.h>
+
+/* Times every feed_info.c function against feeds tables of growing size and captures EXPLAIN ANALYZE for each statement.
+ * Writes are run in a transaction that is rolled back, so every sample sees the same table.
+ * Rerun it before and after a schema, index or query change and compare the numbers and plans. */
+
+// the schema the tables are created in (and dropped from again)
+#define BENCH_SCHEMA "zblock_bench_feed_info"
+
+// feeds a channel is listed with, LIST_PAGE_SIZE in main.c
+#define PAGE_SIZE 5
+
+// updates in a batch, POLLER_BATCH_SIZE in poller.c
+#define BATCH_SIZE 128
+
+// the whole due list is read by these, so they are run fewer times
+#define LIST_RUNS 5
+#define BATCH_RUNS 10
+
+static struct {
+	int sizes[8]; // rows in each table that is benchmarked
+	int nsizes;
+	int samples; // subscriptions each function is timed against
+	const char *plans_path;
+	bool keep; // leave the last table behind to look at
+} opts = {
+	.sizes = { 10000, 100000, 1000000 },
+	.nsizes = 3,
+	.samples = 200,
+	.plans_path = "feed_info_plans.txt"
+};
+
+// only problems are shown
+void log_log(int level, const char *file, int line, const char *fmt, ...) {
+	if (level < LOG_WARN) return;
+	fprintf(stderr, "%s:%d: ", file, line);
+	va_list args;
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	fputc('\n', stderr);
+}
+
+/* Parameters every statement is explained with, {url} {channel} and {guild} are filled in from a subscription.
+ * Unpaginated calls like the list scan have none. */
+static const char *EXPLAIN_ARGS[] = {
+	[STMT_RETRIEVE_LIST] = "",
+	[STMT_EXISTS] = "({url}, {channel})",
+	[STMT_INSERT] = "('https://bench.example.com/new.xml', now(), {channel}, 'New feed', {guild})",
+	[STMT_DELETE] = "({url}, {channel})",
+	[STMT_DELETE_ALL_GUILD] = "({guild})",
+	[STMT_DELETE_ALL_CHANNEL] = "({channel})",
+	[STMT_UPDATE] = "(now(), {url}, {channel})",
+	[STMT_UPDATE_CACHE] = "('\"bench\"', NULL, {url})",
+	[STMT_UPDATE_SCHEDULE] = "(900, {url})",
+	[STMT_UPDATE_HASH] = "(1, {url})",
+	[STMT_COUNT_CHANNEL] = "({channel})",
+	[STMT_RETRIEVE_PAGE_AFTER] = "({channel}, 0, " ZBLOCK_STR(PAGE_SIZE) ")",
+	[STMT_RETRIEVE_PAGE_BEFORE] = "({channel}, 9223372036854775807, " ZBLOCK_STR(PAGE_SIZE) ")"
+};
+static_assert(sizeof(EXPLAIN_ARGS) / sizeof(*EXPLAIN_ARGS) == STMT_COUNT, "Not all statements have explain arguments");
+
+// a subscription from the table that functions are aimed at
+typedef struct {
+	char *url;
+	u64snowflake channel_id;
+	u64snowflake guild_id;
+} bench_target;
+
+static bool exec_ok(PGconn *conn, const char *query) {
+	PGresult *res = PQexec(conn, query);
+	bool ok = PQresultStatus(res) == PGRES_COMMAND_OK || PQresultStatus(res) == PGRES_TUPLES_OK;
+	if (!ok) fprintf(stderr, "feed_info_bench: %s", PQresultErrorMessage(res));
+	PQclear(res);
+	return ok;
+}
+
+/* Creates a table the way an old zblock database had it, migrates it and fills it with rows subscriptions.
+ * Guild sizes are skewed so most guilds have a few feeds and a handful have thousands, spread over up to 8 channels each.
+ * Popular urls are shared by many channels. 5% of the feeds are due to be polled, and stay due for as long as the bench runs. */
+static bool seed(PGconn *conn, int rows) {
+	if (!exec_ok(conn,
+		"DROP TABLE IF EXISTS feeds;"
+		"CREATE TABLE feeds (url text NOT NULL, last_pubDate timestamptz, channel_id bigint NOT NULL, title text, guild_id bigint)"
+	)) return false;
+	// indexes are built before the rows go in, the same as a table that grew over time
+	if (zblock_feed_info_migrate(conn)) return false;
+
+	char params[3][16];
+	snprintf(params[0], sizeof(params[0]), "%d", rows);
+	snprintf(params[1], sizeof(params[1]), "%d", rows / 25 + 1); // guilds
+	snprintf(params[2], sizeof(params[2]), "%d", rows / 3 + 1); // distinct urls
+	const char *const values[] = {params[0], params[1], params[2]};
+	// the same seed gives the same table every run
+	if (!exec_ok(conn, "SELECT setseed(0.25)")) return false;
+	PGresult *res = PQexecParams(conn,
+		"INSERT INTO feeds (url, last_pubDate, channel_id, title, guild_id, next_poll) "
+		"SELECT format('https://feeds%s.example.com/%s.xml', u % 97, u), now() - random() * interval '30 days', "
+		"200000000000000000 + g * 8 + c, format('Feed %s', u), 100000000000000000 + g, "
+		"CASE WHEN random() < 0.05 THEN now() - random() * interval '1 hour' ELSE now() + interval '1 hour' + random() * interval '1 day' END "
+		"FROM (SELECT floor($2::int * power(random(), 3))::bigint AS g, floor(8 * power(random(), 2))::bigint AS c, "
+		"floor($3::int * power(random(), 2))::bigint AS u FROM generate_series(1, $1::int)) AS r "
+		// a channel can only have a url once, so the rows that come out the same are dropped
+		"ON CONFLICT DO NOTHING",
+		3, NULL, values, NULL, NULL, 0
+	);
+	bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+	if (!ok) fprintf(stderr, "feed_info_bench: %s", PQresultErrorMessage(res));
+	PQclear(res);
+	return ok && exec_ok(conn, "VACUUM ANALYZE feeds");
+}
+
+// prints what the table ended up looking like
+static void describe(PGconn *conn, int rows) {
+	PGresult *res = PQexec(conn,
+		"SELECT (SELECT COUNT(*) FROM feeds), (SELECT COUNT(DISTINCT guild_id) FROM feeds), (SELECT COUNT(DISTINCT url) FROM feeds), "
+		"(SELECT COUNT(*) FROM feeds GROUP BY channel_id ORDER BY 1 DESC LIMIT 1), (SELECT COUNT(*) FROM feeds WHERE next_poll <= now())"
+	);
+	if (PQresultStatus(res) == PGRES_TUPLES_OK) {
+		printf("%d rows (%s after duplicates): %s guilds, %s urls, %s feeds in the largest channel, %s due\n", rows,
+			PQgetvalue(res, 0, 0), PQgetvalue(res, 0, 1), PQgetvalue(res, 0, 2), PQgetvalue(res, 0, 3), PQgetvalue(res, 0, 4));
+	}
+	PQclear(res);
+}
+
+/* Picks subscriptions spread evenly through the table. Big channels and guilds come up as often as they do in it,
+ * which is also how often their members run commands. Returns the number picked. */
+static int pick_targets(PGconn *conn, bench_target *targets, int ntargets) {
+	char limit[16];
+	snprintf(limit, sizeof(limit), "%d", ntargets);
+	const char *const values[] = {limit};
+	PGresult *res = PQexecParams(conn,
+		"SELECT url, channel_id, guild_id FROM (SELECT url, channel_id, guild_id, row_number() OVER (ORDER BY id) AS n FROM feeds) AS t "
+		"WHERE n % greatest(1, (SELECT COUNT(*) FROM feeds) / $1::int) = 0 ORDER BY n LIMIT $1::int",
+		1, NULL, values, NULL, NULL, 0
+	);
+	int npicked = 0;
+	if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+		fprintf(stderr, "feed_info_bench: %s", PQresultErrorMessage(res));
+	} else {
+		for (int i = 0; i < PQntuples(res) && npicked < ntargets; ++i) {
+			bench_target *target = &targets[npicked];
+			target->url = strdup(PQgetvalue(res, i, 0));
+			if (!target->url) break;
+			target->channel_id = strtoull(PQgetvalue(res, i, 1), NULL, 10);
+			target->guild_id = strtoull(PQgetvalue(res, i, 2), NULL, 10);
+			++npicked;
+		}
+	}
+	PQclear(res);
+	return npicked;
+}
+
+static int compare_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+	return (x > y) - (x < y);
+}
+
+// prints a line for a function from how long each run took (in microseconds)
+static void report(const char *name, uint64_t *usec, int n) {
+	if (!n) return;
+	qsort(usec, n, sizeof(*usec), compare_u64);
+	uint64_t total = 0;
+	for (int i = 0; i < n; ++i) total += usec[i];
+	printf("  %-34s %6d %10.3f %10.3f %10.3f %10.3f\n", name, n,
+		total / 1000.0 / n, usec[(n - 1) / 2] / 1000.0, usec[(int) ((n - 1) * 0.99)] / 1000.0, usec[n - 1] / 1000.0);
+}
+
+// everything that changes the table is timed inside a transaction that is thrown away afterwards
+static void begin(PGconn *conn) {
+	exec_ok(conn, "BEGIN");
+}
+
+static void rollback(PGconn *conn) {
+	exec_ok(conn, "ROLLBACK");
+}
+
+static void bench_functions(PGconn *conn, const bench_target *targets, int ntargets, uint64_t *usec) {
+	printf("  %-34s %6s %10s %10s %10s %10s\n", "function (ms)", "runs", "mean", "p50", "p99", "max");
+
+	int nrows = 0, nlists = 0;
+	for (int i = 0; i < LIST_RUNS; ++i) {
+		uint64_t start = zblock_metrics_now();
+		if (zblock_feed_info_retrieve_list_begin(conn)) break;
+		zblock_feed_info_minimal feed_info;
+		for (nrows = 0; !zblock_feed_info_retrieve_list_item(conn, &feed_info); ++nrows) zblock_feed_info_minimal_free(&feed_info);
+		usec[nlists++] = zblock_metrics_now() - start;
+	}
+	report("retrieve_list", usec, nlists);
+
+	for (int i = 0; i < ntargets; ++i) {
+		int exists;
+		uint64_t start = zblock_metrics_now();
+		zblock_feed_info_exists(conn, targets[i].url, targets[i].channel_id, &exists);
+		usec[i] = zblock_metrics_now() - start;
+	}
+	report("exists", usec, ntargets);
+
+	for (int i = 0; i < ntargets; ++i) {
+		int64_t count;
+		uint64_t start = zblock_metrics_now();
+		zblock_feed_info_count_channel(conn, targets[i].channel_id, &count);
+		usec[i] = zblock_metrics_now() - start;
+	}
+	report("count_channel", usec, ntargets);
+
+	// the first page and the last, which is what the list command opens on and jumps to
+	for (int last = 0; last < 2; ++last) {
+		for (int i = 0; i < ntargets; ++i) {
+			zblock_feed_info page[PAGE_SIZE];
+			int nretrieved = 0;
+			uint64_t start = zblock_metrics_now();
+			zblock_feed_info_err err = zblock_feed_info_retrieve_page_channel(conn, targets[i].channel_id, last ? INT64_MAX : 0, last, PAGE_SIZE, page, &nretrieved);
+			usec[i] = zblock_metrics_now() - start;
+			for (int j = 0; !err && j < nretrieved; ++j) zblock_feed_info_free(&page[j]);
+		}
+		report(last ? "retrieve_page_channel (last)" : "retrieve_page_channel (first)", usec, ntargets);
+	}
+
+	for (int i = 0; i < ntargets; ++i) {
+		zblock_feed_info feed = {
+			.url = "https://bench.example.com/new.xml",
+			.last_pubDate = time(NULL),
+			.channel_id = targets[i].channel_id,
+			.title = "New feed",
+			.guild_id = targets[i].guild_id
+		};
+		begin(conn);
+		uint64_t start = zblock_metrics_now();
+		zblock_feed_info_insert(conn, &feed);
+		usec[i] = zblock_metrics_now() - start;
+		rollback(conn);
+	}
+	report("insert", usec, ntargets);
+
+	for (int i = 0; i < ntargets; ++i) {
+		begin(conn);
+		uint64_t start = zblock_metrics_now();
+		zblock_feed_info_delete(conn, targets[i].url, targets[i].channel_id);
+		usec[i] = zblock_metrics_now() - start;
+		rollback(conn);
+	}
+	report("delete", usec, ntargets);
+
+	for (int i = 0; i < ntargets; ++i) {
+		begin(conn);
+		uint64_t start = zblock_metrics_now();
+		zblock_feed_info_delete_all_guild(conn, targets[i].guild_id);
+		usec[i] = zblock_metrics_now() - start;
+		rollback(conn);
+	}
+	report("delete_all_guild", usec, ntargets);
+
+	for (int i = 0; i < ntargets; ++i) {
+		begin(conn);
+		uint64_t start = zblock_metrics_now();
+		zblock_feed_info_delete_all_channel(conn, targets[i].channel_id);
+		usec[i] = zblock_metrics_now() - start;
+		rollback(conn);
+	}
+	report("delete_all_channel", usec, ntargets);
+
+	for (int i = 0; i < ntargets; ++i) {
+		zblock_feed_info_minimal feed = { .url = targets[i].url, .last_pubDate = time(NULL), .channel_id = targets[i].channel_id };
+		begin(conn);
+		uint64_t start = zblock_metrics_now();
+		zblock_feed_info_update(conn, &feed);
+		usec[i] = zblock_metrics_now() - start;
+		rollback(conn);
+	}
+	report("update", usec, ntargets);
+
+	for (int i = 0; i < ntargets; ++i) {
+		begin(conn);
+		uint64_t start = zblock_metrics_now();
+		zblock_feed_info_update_cache(conn, targets[i].url, "\"bench\"", NULL);
+		usec[i] = zblock_metrics_now() - start;
+		rollback(conn);
+	}
+	report("update_cache", usec, ntargets);
+
+	for (int i = 0; i < ntargets; ++i) {
+		begin(conn);
+		uint64_t start = zblock_metrics_now();
+		zblock_feed_info_update_schedule(conn, targets[i].url, 900);
+		usec[i] = zblock_metrics_now() - start;
+		rollback(conn);
+	}
+	report("update_schedule", usec, ntargets);
+
+	/* A full batch the way the poller sends one: a schedule and a hash for every feed it fetched.
+	 * Without pipelining the batch commits its own transaction, so these updates stay. */
+	int nbatches = 0;
+	for (int i = 0; i < BATCH_RUNS; ++i) {
+		zblock_feed_info_batch *batch = zblock_feed_info_batch_new(conn, 0);
+		if (!batch) break;
+		for (int j = 0; j < BATCH_SIZE / 2; ++j) {
+			const bench_target *target = &targets[(i * BATCH_SIZE / 2 + j) % ntargets];
+			zblock_feed_info_batch_update_schedule(batch, target->url, 900);
+			zblock_feed_info_batch_update_hash(batch, target->url, j + 1);
+		}
+		begin(conn);
+		uint64_t start = zblock_metrics_now();
+		zblock_feed_info_batch_flush(batch);
+		usec[nbatches++] = zblock_metrics_now() - start;
+		rollback(conn);
+		zblock_feed_info_batch_delete(batch);
+	}
+	report("batch_flush (" ZBLOCK_STR(BATCH_SIZE) " updates)", usec, nbatches);
+	printf("  (%d feeds due in the list)\n", nrows);
+}
+
+// fills in an explain argument list, escaping the url
+static char *explain_args(PGconn *conn, const char *args, const bench_target *target) {
+	char *url = PQescapeLiteral(conn, target->url, strlen(target->url));
+	if (!url) return NULL;
+	char channel[24], guild[24];
+	snprintf(channel, sizeof(channel), "%" PRIu64, target->channel_id);
+	snprintf(guild, sizeof(guild), "%" PRIu64, target->guild_id);
+
+	char *expanded;
+	size_t len;
+	FILE *out = open_memstream(&expanded, &len);
+	if (!out) {
+		PQfreemem(url);
+		return NULL;
+	}
+	while (*args) {
+		if (!strncmp(args, "{url}", 5)) {
+			fputs(url, out);
+			args += 5;
+		} else if (!strncmp(args, "{channel}", 9)) {
+			fputs(channel, out);
+			args += 9;
+		} else if (!strncmp(args, "{guild}", 7)) {
+			fputs(guild, out);
+			args += 7;
+		} else {
+			fputc(*args++, out);
+		}
+	}
+	PQfreemem(url);
+	return fclose(out) ? NULL : expanded;
+}
+
+/* Writes the plan of every prepared statement, run against the subscription in the largest channel.
+ * Plans come from EXECUTE so they are the ones the bot actually gets, generic or not. */
+static void explain_statements(PGconn *conn, FILE *plans, int rows, const bench_target *target) {
+	for (int i = 0; i < STMT_COUNT; ++i) {
+		char *args = explain_args(conn, EXPLAIN_ARGS[i], target);
+		char *query;
+		if (!args || asprintf(&query, "EXPLAIN (ANALYZE, BUFFERS) EXECUTE %s%s", STATEMENTS[i].name, args) < 0) {
+			free(args);
+			continue;
+		}
+		free(args);
+
+		fprintf(plans, "=== %d rows: %s\n%s\n\n", rows, STATEMENTS[i].name, STATEMENTS[i].sql);
+		begin(conn);
+		PGresult *res = PQexec(conn, query);
+		if (PQresultStatus(res) == PGRES_TUPLES_OK) {
+			for (int j = 0; j < PQntuples(res); ++j) fprintf(plans, "%s\n", PQgetvalue(res, j, 0));
+		} else {
+			fprintf(plans, "%s", PQresultErrorMessage(res));
+		}
+		PQclear(res);
+		rollback(conn);
+		fputc('\n', plans);
+		free(query);
+	}
+}
+
+// the subscription in the channel with the most feeds, the worst case for the channel queries
+static bool largest_channel_target(PGconn *conn, bench_target *target) {
+	PGresult *res = PQexec(conn,
+		"SELECT url, channel_id, guild_id FROM feeds WHERE channel_id = "
+		"(SELECT channel_id FROM feeds GROUP BY channel_id ORDER BY COUNT(*) DESC LIMIT 1) LIMIT 1"
+	);
+	bool ok = PQresultStatus(res) == PGRES_TUPLES_OK && PQntuples(res);
+	if (ok) {
+		target->url = strdup(PQgetvalue(res, 0, 0));
+		target->channel_id = strtoull(PQgetvalue(res, 0, 1), NULL, 10);
+		target->guild_id = strtoull(PQgetvalue(res, 0, 2), NULL, 10);
+		ok = target->url;
+	}
+	PQclear(res);
+	return ok;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr,
+		"usage: %s [-d conninfo] [-s rows,rows,...] [-n samples] [-p plans file] [-k]\n"
+		"the database comes from -d or ZBLOCK_BENCH_CONNINFO. the schema " BENCH_SCHEMA " is created in it and dropped unless -k is given.\n",
+		name);
+}
+
+int main(int argc, char *argv[]) {
+	const char *conninfo = getenv("ZBLOCK_BENCH_CONNINFO");
+	int opt;
+	while ((opt = getopt(argc, argv, "d:s:n:p:k")) != -1) {
+		switch (opt) {
+		case 'd': conninfo = optarg; break;
+		case 's':
+			opts.nsizes = 0;
+			for (char *size = strtok(optarg, ","); size && opts.nsizes < (int) (sizeof(opts.sizes) / sizeof(*opts.sizes)); size = strtok(NULL, ",")) {
+				opts.sizes[opts.nsizes++] = atoi(size);
+			}
+			break;
+		case 'n': opts.samples = atoi(optarg); break;
+		case 'p': opts.plans_path = optarg; break;
+		case 'k': opts.keep = true; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+	bool valid = opts.nsizes && opts.samples > 0;
+	for (int i = 0; i < opts.nsizes; ++i) valid = valid && opts.sizes[i] > 0;
+	if (!valid) {
+		usage(argv[0]);
+		return 1;
+	}
+	// make bench runs everything, so no database isn't a failure
+	if (!conninfo) {
+		puts("feed_info_bench: skipped, set ZBLOCK_BENCH_CONNINFO to a postgres database it can create a schema in");
+		return 0;
+	}
+
+	PGconn *conn = PQconnectdb(conninfo);
+	if (PQstatus(conn) != CONNECTION_OK) {
+		fprintf(stderr, "feed_info_bench: %s", PQerrorMessage(conn));
+		PQfinish(conn);
+		return 1;
+	}
+	FILE *plans = fopen(opts.plans_path, "w");
+	bench_target *targets = calloc(opts.samples, sizeof(*targets));
+	// every run needs a slot, whichever function takes the most
+	int nusec = opts.samples > BATCH_RUNS ? opts.samples : BATCH_RUNS;
+	uint64_t *usec = malloc((nusec > LIST_RUNS ? nusec : LIST_RUNS) * sizeof(*usec));
+	if (!plans || !targets || !usec) {
+		perror("feed_info_bench");
+		if (plans) fclose(plans);
+		free(targets);
+		free(usec);
+		PQfinish(conn);
+		return 1;
+	}
+
+	int status = 1;
+	if (!exec_ok(conn, "DROP SCHEMA IF EXISTS " BENCH_SCHEMA " CASCADE; CREATE SCHEMA " BENCH_SCHEMA "; SET search_path TO " BENCH_SCHEMA)) goto out;
+	for (int size = 0; size < opts.nsizes; ++size) {
+		int rows = opts.sizes[size];
+		// statements are prepared against the table they run on, so they go before it is replaced
+		exec_ok(conn, "DEALLOCATE ALL");
+		uint64_t start = zblock_metrics_now();
+		if (!seed(conn, rows)) goto drop;
+		printf("%sseeded in %.1fs, ", size ? "\n" : "", (zblock_metrics_now() - start) / 1e6);
+		describe(conn, rows);
+		if (zblock_feed_info_prepare(conn)) goto drop;
+
+		int ntargets = pick_targets(conn, targets, opts.samples);
+		bench_target largest = {0};
+		bool picked = ntargets && largest_channel_target(conn, &largest);
+		if (picked) {
+			bench_functions(conn, targets, ntargets, usec);
+			explain_statements(conn, plans, rows, &largest);
+		}
+		free(largest.url);
+		for (int i = 0; i < ntargets; ++i) free(targets[i].url);
+		if (!picked) {
+			fputs("feed_info_bench: unable to pick feeds to benchmark with\n", stderr);
+			goto drop;
+		}
+	}
+	printf("\nplans written to %s\n", opts.plans_path);
+	status = 0;
+
+	drop:
+	if (!opts.keep) exec_ok(conn, "DROP SCHEMA IF EXISTS " BENCH_SCHEMA " CASCADE");
+	out:
+	if (fclose(plans)) status = 1;
+	free(targets);
+	free(usec);
+	PQfinish(conn);
+	return status;
+}
@@ -0,0 +1,590 @@
+// the poller is included whole so a cycle can be run on this thread and timed
+#include "../poller.c"
+
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+/* Runs whole poll cycles against thousands of synthetic feeds served from a child process,
+ * with the feed list in a postgres schema of its own and posts going to a sink instead of discord.
+ * Reports feeds per second, how long a new item takes from being served to being posted,
+ * peak RSS and how many trips to the database a cycle makes. */
+
+// the schema the fixture creates (and drops again) in the bench database
+#define BENCH_SCHEMA "zblock_bench"
+
+// pubDate of the first item of every feed, the rest follow a minute apart
+#define BASE_PUBDATE 1700000000
+#define ITEM_SPACING 60
+
+static struct {
+	int feeds;
+	int subs; // subscriptions to every feed
+	int per_channel; // feeds sharing a channel
+	int hosts; // feeds are spread over 127.0.0.1 and up
+	int items; // items in every feed
+	int item_size; // bytes of description in every item
+	int latency_ms; // average time the server takes to answer, give or take half
+	double change_rate; // chance a feed gets a new item in a cycle
+	int atom_percent; // how many feeds are atom instead of rss
+	int cycles;
+	int max_connections;
+	int max_host_connections;
+	bool keep; // leave the schema behind to look at
+} opts = {
+	.feeds = 2000,
+	.subs = 1,
+	.per_channel = 1,
+	.hosts = 50,
+	.items = 20,
+	.item_size = 200,
+	.latency_ms = 50,
+	.change_rate = 0.1,
+	.atom_percent = 25,
+	.cycles = 5,
+	.max_connections = ZBLOCK_CONFIG_DEFAULT_MAX_CONNECTIONS,
+	.max_host_connections = ZBLOCK_CONFIG_DEFAULT_MAX_HOST_CONNECTIONS
+};
+
+// shared with the server after it forks
+static struct {
+	_Atomic int cycle; // 0 is the warm up, nothing changes in it
+	_Atomic uint64_t served_at[]; // when each feed's latest version was first sent out
+} *shared;
+
+struct zblock_config zblock_config;
+
+static int server_port;
+static char *padding;
+
+// only problems are shown, the poller's info logs would drown out the results
+static unsigned long log_problems;
+void log_log(int level, const char *file, int line, const char *fmt, ...) {
+	if (level < LOG_WARN) return;
+	// a misconfigured run fails the same way for every feed, a few are enough to tell why
+	if (log_problems++ >= 10) return;
+	fprintf(stderr, "%s:%d: ", file, line);
+	va_list args;
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	fputc('\n', stderr);
+}
+
+// splitmix64, so every feed changes in the same cycles on every run
+static uint64_t mix(uint64_t x) {
+	x += 0x9e3779b97f4a7c15;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+	return x ^ (x >> 31);
+}
+
+static bool feed_changed(int feed, int cycle) {
+	return cycle > 0 && mix((uint64_t) feed << 32 | cycle) % 1000000 < opts.change_rate * 1000000;
+}
+
+// how many items a feed has gained by a cycle
+static int feed_version(int feed, int cycle) {
+	int version = 0;
+	for (int i = 1; i <= cycle; ++i) version += feed_changed(feed, i);
+	return version;
+}
+
+static void write_date(FILE *out, const char *format, time_t date) {
+	char buf[64];
+	struct tm tm;
+	strftime(buf, sizeof(buf), format, gmtime_r(&date, &tm));
+	fputs(buf, out);
+}
+
+// the body of a feed at a version, newest item first
+static char *feed_body(int feed, int version, size_t *len) {
+	char *body;
+	FILE *out = open_memstream(&body, len);
+	if (!out) return NULL;
+
+	int host = 1 + feed % opts.hosts;
+	bool atom = feed % 100 < opts.atom_percent;
+	if (atom) fprintf(out, "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<feed xmlns=\"http://www.w3.org/2005/Atom\">\n<title>Feed %d</title>\n", feed);
+	else fprintf(out, "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<rss version=\"2.0\">\n<channel>\n<title>Feed %d</title>\n<link>http://127.0.0.%d:%d/</link>\n<description>Synthetic feed</description>\n", feed, host, server_port);
+
+	for (int item = version + opts.items - 1; item >= version; --item) {
+		time_t date = BASE_PUBDATE + (time_t) item * ITEM_SPACING;
+		if (atom) {
+			fprintf(out, "<entry>\n<title>Item %d</title>\n<link rel=\"alternate\" href=\"http://127.0.0.%d:%d/feed/%d/%d\"/>\n<updated>", item, host, server_port, feed, item);
+			write_date(out, "%Y-%m-%dT%H:%M:%SZ", date);
+			fputs("</updated>\n<summary>", out);
+			fwrite(padding, 1, opts.item_size, out);
+			fputs("</summary>\n</entry>\n", out);
+		} else {
+			fprintf(out, "<item>\n<title>Item %d</title>\n<link>http://127.0.0.%d:%d/feed/%d/%d</link>\n<pubDate>", item, host, server_port, feed, item);
+			write_date(out, "%a, %d %b %Y %H:%M:%S GMT", date);
+			fputs("</pubDate>\n<description>", out);
+			fwrite(padding, 1, opts.item_size, out);
+			fputs("</description>\n</item>\n", out);
+		}
+	}
+
+	fputs(atom ? "</feed>\n" : "</channel>\n</rss>\n", out);
+	if (fclose(out)) return NULL;
+	return body;
+}
+
+// a connection to the feed server
+struct conn {
+	int fd;
+	char in[8192]; // kept null terminated
+	size_t in_len;
+	char *out; // the response, NULL if there isn't one
+	size_t out_len, out_sent;
+	uint64_t ready_at; // when the response goes out
+	int served_feed; // feed whose new version is in out, -1 if it's a 304
+};
+
+/* Builds the response to the request at the start of conn->in, which has to be complete.
+ * Returns false if out of memory. */
+static bool conn_respond(struct conn *conn) {
+	conn->served_feed = -1;
+	int feed;
+	if (sscanf(conn->in, "GET /feed/%d ", &feed) != 1 || feed < 0 || feed >= opts.feeds) {
+		static const char NOT_FOUND[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+		conn->out = strdup(NOT_FOUND);
+		conn->out_len = sizeof(NOT_FOUND) - 1;
+		return conn->out;
+	}
+
+	int version = feed_version(feed, atomic_load(&shared->cycle));
+	char etag[32];
+	snprintf(etag, sizeof(etag), "\"%d-%d\"", feed, version);
+	const char *if_none_match = strcasestr(conn->in, "\r\nIf-None-Match:");
+	if (if_none_match) {
+		if_none_match += strlen("\r\nIf-None-Match:");
+		while (*if_none_match == ' ') ++if_none_match;
+		if (!strncmp(if_none_match, etag, strlen(etag))) {
+			int len = asprintf(&conn->out, "HTTP/1.1 304 Not Modified\r\nETag: %s\r\n\r\n", etag);
+			if (len < 0) {
+				conn->out = NULL;
+				return false;
+			}
+			conn->out_len = len;
+			return true;
+		}
+	}
+
+	size_t body_len;
+	char *body = feed_body(feed, version, &body_len);
+	if (!body) return false;
+	char *headers;
+	int headers_len = asprintf(&headers, "HTTP/1.1 200 OK\r\nContent-Type: application/%s+xml\r\nETag: %s\r\nContent-Length: %zu\r\n\r\n",
+		feed % 100 < opts.atom_percent ? "atom" : "rss", etag, body_len);
+	if (headers_len < 0) {
+		free(body);
+		return false;
+	}
+	conn->out = malloc(headers_len + body_len);
+	if (conn->out) {
+		memcpy(conn->out, headers, headers_len);
+		memcpy(conn->out + headers_len, body, body_len);
+		conn->out_len = headers_len + body_len;
+		conn->served_feed = feed;
+	}
+	free(headers);
+	free(body);
+	return conn->out;
+}
+
+// starts on the next request if a whole one has come in. returns false if the connection should be closed.
+static bool conn_next_request(struct conn *conn, uint64_t *rng) {
+	if (conn->out) return true;
+	char *end = strstr(conn->in, "\r\n\r\n");
+	if (!end) return conn->in_len < sizeof(conn->in) - 1;
+
+	if (!conn_respond(conn)) return false;
+	conn->out_sent = 0;
+	*rng = mix(*rng);
+	uint64_t delay = opts.latency_ms * 1000ULL;
+	delay = delay / 2 + (delay ? *rng % (delay + 1) : 0);
+	conn->ready_at = zblock_metrics_now() + delay;
+
+	// requests can be pipelined, so whatever follows this one is kept
+	size_t consumed = end + 4 - conn->in;
+	memmove(conn->in, conn->in + consumed, conn->in_len - consumed + 1);
+	conn->in_len -= consumed;
+	return true;
+}
+
+// sends as much of the response as the socket takes. returns false if the connection should be closed.
+static bool conn_write(struct conn *conn) {
+	if (!conn->out_sent && conn->served_feed >= 0) atomic_store(&shared->served_at[conn->served_feed], zblock_metrics_now());
+	ssize_t n = write(conn->fd, conn->out + conn->out_sent, conn->out_len - conn->out_sent);
+	if (n < 0) return errno == EAGAIN;
+	conn->out_sent += n;
+	if (conn->out_sent == conn->out_len) {
+		free(conn->out);
+		conn->out = NULL;
+	}
+	return true;
+}
+
+// serves feeds until killed. runs in the child process.
+static void serve(const int *listeners) {
+	struct conn *conns = NULL;
+	size_t nconns = 0, conns_capacity = 0;
+	struct pollfd *fds = NULL;
+	uint64_t rng = getpid();
+
+	for (;;) {
+		struct pollfd *new_fds = realloc(fds, (opts.hosts + nconns) * sizeof(*fds));
+		if (!new_fds) break;
+		fds = new_fds;
+		for (int i = 0; i < opts.hosts; ++i) fds[i] = (struct pollfd) { .fd = listeners[i], .events = POLLIN };
+
+		// responses wait out their latency before they're written
+		uint64_t now = zblock_metrics_now();
+		int timeout = -1;
+		for (size_t i = 0; i < nconns; ++i) {
+			struct conn *conn = &conns[i];
+			short events = POLLIN;
+			if (conn->out && conn->ready_at <= now) {
+				events = POLLOUT;
+			} else if (conn->out) {
+				events = 0;
+				int wait = (conn->ready_at - now + 999) / 1000;
+				if (timeout < 0 || wait < timeout) timeout = wait;
+			}
+			fds[opts.hosts + i] = (struct pollfd) { .fd = conn->fd, .events = events };
+		}
+		if (poll(fds, opts.hosts + nconns, timeout) < 0 && errno != EINTR) break;
+
+		for (size_t i = 0; i < nconns; ++i) {
+			struct conn *conn = &conns[i];
+			short revents = fds[opts.hosts + i].revents;
+			bool open = true;
+			if (revents & POLLIN) {
+				ssize_t n = read(conn->fd, conn->in + conn->in_len, sizeof(conn->in) - 1 - conn->in_len);
+				if (n > 0) {
+					conn->in_len += n;
+					conn->in[conn->in_len] = '\0';
+				} else if (!n || errno != EAGAIN) {
+					open = false;
+				}
+			} else if (revents & (POLLERR | POLLHUP)) {
+				open = false;
+			}
+			if (open && conn->out && conn->ready_at <= zblock_metrics_now()) open = conn_write(conn);
+			if (open) open = conn_next_request(conn, &rng);
+			if (!open) {
+				close(conn->fd);
+				free(conn->out);
+				conn->fd = -1;
+			}
+		}
+
+		// closed connections are swapped out with the last one
+		for (size_t i = 0; i < nconns;) {
+			if (conns[i].fd < 0) conns[i] = conns[--nconns];
+			else ++i;
+		}
+
+		for (int i = 0; i < opts.hosts; ++i) {
+			if (!(fds[i].revents & POLLIN)) continue;
+			int fd;
+			while ((fd = accept4(listeners[i], NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+				if (nconns == conns_capacity) {
+					size_t new_capacity = conns_capacity ? conns_capacity * 2 : 64;
+					struct conn *new_conns = realloc(conns, new_capacity * sizeof(*new_conns));
+					if (!new_conns) {
+						close(fd);
+						break;
+					}
+					conns = new_conns;
+					conns_capacity = new_capacity;
+				}
+				conns[nconns] = (struct conn) { .fd = fd };
+				conns[nconns].in[0] = '\0';
+				++nconns;
+			}
+		}
+	}
+	perror("poller_bench: feed server");
+}
+
+/* Listens on 127.0.0.1 up to 127.0.0.<hosts>, all on the same port, so the poller limits connections to each separately.
+ * Returns the port, or -1 if one couldn't be found. */
+static int open_listeners(int *listeners) {
+	for (int attempt = 0; attempt < 10; ++attempt) {
+		int port = 0, nopen = 0;
+		for (; nopen < opts.hosts; ++nopen) {
+			int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+			if (fd < 0) break;
+			struct sockaddr_in addr = {
+				.sin_family = AF_INET,
+				.sin_port = htons(port),
+				.sin_addr.s_addr = htonl(INADDR_LOOPBACK + nopen)
+			};
+			socklen_t addr_len = sizeof(addr);
+			if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) || listen(fd, 1024)
+				|| (!port && getsockname(fd, (struct sockaddr *) &addr, &addr_len))) {
+				close(fd);
+				break;
+			}
+			port = ntohs(addr.sin_port);
+			listeners[nopen] = fd;
+		}
+		if (nopen == opts.hosts) return port;
+		while (nopen--) close(listeners[nopen]);
+	}
+	return -1;
+}
+
+// every post that would have gone to discord, and how long each item took to get here
+static struct {
+	unsigned long messages;
+	uint64_t *latencies; // in microseconds
+	size_t nlatencies;
+	size_t latencies_capacity;
+} sink;
+
+// stands in for the outbox, which would only measure discord's rate limits
+zblock_outbox_err zblock_outbox_send(u64snowflake channel_id, const char *content) {
+	(void) channel_id;
+	uint64_t now = zblock_metrics_now();
+	++sink.messages;
+	// every item is a markdown link ending in /feed/<feed>/<item>
+	for (const char *link = content; (link = strstr(link, "/feed/"));) {
+		char *end;
+		long feed = strtol(link + strlen("/feed/"), &end, 10);
+		link = end;
+		if (*end != '/' || feed < 0 || feed >= opts.feeds) continue;
+		if (sink.nlatencies == sink.latencies_capacity) {
+			size_t new_capacity = sink.latencies_capacity ? sink.latencies_capacity * 2 : 1024;
+			uint64_t *new_latencies = realloc(sink.latencies, new_capacity * sizeof(*new_latencies));
+			if (!new_latencies) return ZBLOCK_OUTBOX_NOMEM;
+			sink.latencies = new_latencies;
+			sink.latencies_capacity = new_capacity;
+		}
+		sink.latencies[sink.nlatencies++] = now - atomic_load(&shared->served_at[feed]);
+	}
+	return ZBLOCK_OUTBOX_OK;
+}
+
+const char *zblock_outbox_strerror(zblock_outbox_err error) {
+	return error == ZBLOCK_OUTBOX_OK ? "OK" : "Out of memory";
+}
+
+static bool exec_ok(PGconn *conn, const char *query) {
+	PGresult *res = PQexec(conn, query);
+	bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+	if (!ok) fprintf(stderr, "poller_bench: %s", PQresultErrorMessage(res));
+	PQclear(res);
+	return ok;
+}
+
+/* Creates the feeds table the way an old zblock database had it, migrates it and subscribes to every feed.
+ * Every subscription has already seen the feed's first version, so only new items are posted. */
+static bool fixture_setup(PGconn *conn) {
+	if (!exec_ok(conn,
+		"DROP SCHEMA IF EXISTS " BENCH_SCHEMA " CASCADE;"
+		"CREATE SCHEMA " BENCH_SCHEMA ";"
+		"CREATE TABLE feeds (url text NOT NULL, last_pubDate timestamptz, channel_id bigint NOT NULL, title text, guild_id bigint)"
+	)) return false;
+	if (zblock_feed_info_migrate(conn)) return false;
+
+	char params[6][16];
+	snprintf(params[0], sizeof(params[0]), "%d", server_port);
+	snprintf(params[1], sizeof(params[1]), "%d", opts.hosts);
+	snprintf(params[2], sizeof(params[2]), "%d", opts.feeds);
+	snprintf(params[3], sizeof(params[3]), "%d", opts.subs);
+	snprintf(params[4], sizeof(params[4]), "%d", opts.per_channel);
+	snprintf(params[5], sizeof(params[5]), "%ld", (long) BASE_PUBDATE + (long) (opts.items - 1) * ITEM_SPACING);
+	const char *const values[] = {params[0], params[1], params[2], params[3], params[4], params[5]};
+	PGresult *res = PQexecParams(conn,
+		"INSERT INTO feeds (url, last_pubDate, channel_id, title, guild_id) "
+		"SELECT format('http://127.0.0.%s:%s/feed/%s', 1 + f % $2::int, $1::int, f), to_timestamp($6::bigint), "
+		"1000 + (f / $5::int) * $4::int + s, format('Feed %s', f), 1 "
+		"FROM generate_series(0, $3::int - 1) f, generate_series(0, $4::int - 1) s",
+		6, NULL, values, NULL, NULL, 0
+	);
+	bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+	if (!ok) fprintf(stderr, "poller_bench: %s", PQresultErrorMessage(res));
+	PQclear(res);
+	return ok && exec_ok(conn, "ANALYZE feeds");
+}
+
+static int compare_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+	return (x > y) - (x < y);
+}
+
+static double percentile_ms(const uint64_t *sorted, size_t n, double p) {
+	return n ? sorted[(size_t) ((n - 1) * p)] / 1000.0 : 0;
+}
+
+static uint64_t db_round_trips(void) {
+	return zblock_metrics_count(ZBLOCK_METRIC_DB_QUERY_DURATION) + zblock_metrics_count(ZBLOCK_METRIC_DB_BATCH_DURATION);
+}
+
+static void usage(const char *name) {
+	fprintf(stderr,
+		"usage: %s [-d conninfo] [-f feeds] [-s subs per feed] [-p feeds per channel] [-H hosts] [-i items] [-b item bytes]\n"
+		"          [-l latency ms] [-r change rate] [-a atom percent] [-n cycles] [-c connections] [-C host connections] [-k]\n"
+		"the database comes from -d or ZBLOCK_BENCH_CONNINFO. the schema " BENCH_SCHEMA " is created in it and dropped unless -k is given.\n",
+		name);
+}
+
+int main(int argc, char *argv[]) {
+	const char *conninfo = getenv("ZBLOCK_BENCH_CONNINFO");
+	int opt;
+	while ((opt = getopt(argc, argv, "d:f:s:p:H:i:b:l:r:a:n:c:C:k")) != -1) {
+		switch (opt) {
+		case 'd': conninfo = optarg; break;
+		case 'f': opts.feeds = atoi(optarg); break;
+		case 's': opts.subs = atoi(optarg); break;
+		case 'p': opts.per_channel = atoi(optarg); break;
+		case 'H': opts.hosts = atoi(optarg); break;
+		case 'i': opts.items = atoi(optarg); break;
+		case 'b': opts.item_size = atoi(optarg); break;
+		case 'l': opts.latency_ms = atoi(optarg); break;
+		case 'r': opts.change_rate = atof(optarg); break;
+		case 'a': opts.atom_percent = atoi(optarg); break;
+		case 'n': opts.cycles = atoi(optarg); break;
+		case 'c': opts.max_connections = atoi(optarg); break;
+		case 'C': opts.max_host_connections = atoi(optarg); break;
+		case 'k': opts.keep = true; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+	if (opts.feeds < 1 || opts.subs < 1 || opts.per_channel < 1 || opts.hosts < 1 || opts.hosts > 250 || opts.items < 1
+		|| opts.item_size < 0 || opts.latency_ms < 0 || opts.change_rate < 0 || opts.change_rate > 1
+		|| opts.atom_percent < 0 || opts.atom_percent > 100 || opts.cycles < 1 || opts.max_connections < 1 || opts.max_host_connections < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+	// make bench runs everything, so no database isn't a failure
+	if (!conninfo) {
+		puts("poller_bench: skipped, set ZBLOCK_BENCH_CONNINFO to a postgres database it can create a schema in");
+		return 0;
+	}
+
+	shared = mmap(NULL, sizeof(*shared) + opts.feeds * sizeof(*shared->served_at), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	padding = malloc(opts.item_size + 1);
+	int *listeners = malloc(opts.hosts * sizeof(*listeners));
+	if (shared == MAP_FAILED || !padding || !listeners) {
+		perror("poller_bench");
+		return 1;
+	}
+	for (int i = 0; i < opts.item_size; ++i) padding[i] = "lorem ipsum dolor sit amet "[i % 27];
+	padding[opts.item_size] = '\0';
+
+	server_port = open_listeners(listeners);
+	if (server_port < 0) {
+		perror("poller_bench: unable to listen");
+		return 1;
+	}
+	pid_t server = fork();
+	if (server < 0) {
+		perror("poller_bench: fork");
+		return 1;
+	}
+	if (!server) {
+		// the server lives in its own process so it doesn't count towards the poller's RSS
+		prctl(PR_SET_PDEATHSIG, SIGKILL);
+		serve(listeners);
+		_exit(1);
+	}
+	for (int i = 0; i < opts.hosts; ++i) close(listeners[i]);
+	free(listeners);
+
+	// every connection, including the pool's, only sees the bench schema
+	setenv("PGOPTIONS", "-c search_path=" BENCH_SCHEMA, 1);
+	int status = 1;
+	PGconn *fixture = PQconnectdb(conninfo);
+	if (PQstatus(fixture) != CONNECTION_OK) {
+		fprintf(stderr, "poller_bench: %s", PQerrorMessage(fixture));
+		goto out;
+	}
+	if (!fixture_setup(fixture)) goto drop;
+
+	zblock_config = (struct zblock_config) {
+		.conninfo = (char *) conninfo,
+		.max_connections = opts.max_connections,
+		.max_host_connections = opts.max_host_connections,
+		.db_connections = ZBLOCK_CONFIG_MIN_DB_CONNECTIONS
+	};
+	zblock_db_pool_err pool_err = zblock_db_pool_init(conninfo, zblock_config.db_connections);
+	if (pool_err) {
+		fprintf(stderr, "poller_bench: %s\n", zblock_db_pool_strerror(pool_err));
+		goto drop;
+	}
+	curl_global_init(CURL_GLOBAL_ALL);
+	poller.multi = curl_multi_init();
+	if (!poller.multi) {
+		fputs("poller_bench: unable to create curl multi handle\n", stderr);
+		goto destroy;
+	}
+
+	printf("%d feeds (%d%% atom, %d items of %d bytes) on %d hosts, %d subscription%s each, %d per channel\n",
+		opts.feeds, opts.atom_percent, opts.items, opts.item_size, opts.hosts, opts.subs, opts.subs == 1 ? "" : "s", opts.per_channel);
+	printf("%dms latency, %g%% change per cycle, %d connections (%d per host)\n\n",
+		opts.latency_ms, opts.change_rate * 100, opts.max_connections, opts.max_host_connections);
+
+	uint64_t total_usec = 0, total_round_trips = 0;
+	for (int cycle = 0; cycle <= opts.cycles; ++cycle) {
+		atomic_store(&shared->cycle, cycle);
+		// the poller schedules feeds into the future, everything is made due again so every cycle does the same work
+		if (!exec_ok(fixture, "UPDATE feeds SET next_poll = now()")) goto cleanup;
+
+		unsigned long messages = sink.messages;
+		size_t items = sink.nlatencies;
+		uint64_t round_trips = db_round_trips();
+		uint64_t start = zblock_metrics_now();
+		retrieve_feeds();
+		uint64_t usec = zblock_metrics_now() - start;
+		round_trips = db_round_trips() - round_trips;
+
+		// the first cycle downloads every feed in full, opens every connection and fills the validators
+		if (!cycle) {
+			printf("warm up: %.3fs, %" PRIu64 " database round trips\n", usec / 1e6, round_trips);
+			continue;
+		}
+		total_usec += usec;
+		total_round_trips += round_trips;
+		printf("cycle %d: %.3fs, %.0f feeds/s, %zu items in %lu messages, %" PRIu64 " database round trips\n",
+			cycle, usec / 1e6, opts.feeds / (usec / 1e6), sink.nlatencies - items, sink.messages - messages, round_trips);
+	}
+
+	qsort(sink.latencies, sink.nlatencies, sizeof(*sink.latencies), compare_u64);
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	printf("\nfeeds/s: %.0f\n", (double) opts.feeds * opts.cycles / (total_usec / 1e6));
+	printf("fetch to post: p50 %.1fms, p99 %.1fms over %zu items\n",
+		percentile_ms(sink.latencies, sink.nlatencies, 0.5), percentile_ms(sink.latencies, sink.nlatencies, 0.99), sink.nlatencies);
+	printf("peak RSS: %ld KiB\n", usage.ru_maxrss);
+	printf("database round trips per cycle: %.1f\n", (double) total_round_trips / opts.cycles);
+	if (log_problems) printf("%lu warnings and errors logged\n", log_problems);
+	status = 0;
+
+	cleanup:
+	curl_multi_cleanup(poller.multi);
+	destroy:
+	zblock_db_pool_destroy();
+	drop:
+	if (!opts.keep) exec_ok(fixture, "DROP SCHEMA IF EXISTS " BENCH_SCHEMA " CASCADE");
+	out:
+	PQfinish(fixture);
+	kill(server, SIGKILL);
+	waitpid(server, NULL, 0);
+	free(sink.latencies);
+	free(padding);
+	return status;
+}
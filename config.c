@@ -38,6 +38,38 @@ zblock_config_err zblock_config_load(struct discord *client) {
 	zblock_config.storytime_channel = 0; // initialize it with something
 	if (storytime_channel.size > 0) zblock_config.storytime_channel = strtoull(storytime_channel.start, NULL, 10);
 	
+	// connection limits for the poller
+	struct ccord_szbuf_readonly max_connections = discord_config_get_field(client, (char *[2]){"zblock", "max_connections"}, 2);
+	zblock_config.max_connections = max_connections.size > 0 ? strtol(max_connections.start, NULL, 10) : 0;
+	if (zblock_config.max_connections <= 0) zblock_config.max_connections = ZBLOCK_CONFIG_DEFAULT_MAX_CONNECTIONS;
+	
+	struct ccord_szbuf_readonly max_host_connections = discord_config_get_field(client, (char *[2]){"zblock", "max_host_connections"}, 2);
+	zblock_config.max_host_connections = max_host_connections.size > 0 ? strtol(max_host_connections.start, NULL, 10) : 0;
+	if (zblock_config.max_host_connections <= 0) zblock_config.max_host_connections = ZBLOCK_CONFIG_DEFAULT_MAX_HOST_CONNECTIONS;
+	
+	struct ccord_szbuf_readonly db_connections = discord_config_get_field(client, (char *[2]){"zblock", "db_connections"}, 2);
+	zblock_config.db_connections = db_connections.size > 0 ? strtol(db_connections.start, NULL, 10) : 0;
+	if (zblock_config.db_connections <= 0) zblock_config.db_connections = ZBLOCK_CONFIG_DEFAULT_DB_CONNECTIONS;
+	else if (zblock_config.db_connections < ZBLOCK_CONFIG_MIN_DB_CONNECTIONS) zblock_config.db_connections = ZBLOCK_CONFIG_MIN_DB_CONNECTIONS;
+	
+	// metrics are only written if there's somewhere to put them
+	struct ccord_szbuf_readonly metrics_file = discord_config_get_field(client, (char *[2]){"zblock", "metrics_file"}, 2);
+	zblock_config.metrics_file = NULL;
+	if (metrics_file.size > 0 && asprintf(&zblock_config.metrics_file, "%.*s", (int)metrics_file.size, metrics_file.start) < 0) {
+		zblock_config.metrics_file = NULL;
+	}
+	
+	// cycles are only traced if there's somewhere to put them
+	struct ccord_szbuf_readonly trace_file = discord_config_get_field(client, (char *[3]){"zblock", "trace", "file"}, 3);
+	zblock_config.trace_file = NULL;
+	if (trace_file.size > 0 && asprintf(&zblock_config.trace_file, "%.*s", (int)trace_file.size, trace_file.start) < 0) {
+		zblock_config.trace_file = NULL;
+	}
+	
+	struct ccord_szbuf_readonly trace_min_cycle_ms = discord_config_get_field(client, (char *[3]){"zblock", "trace", "min_cycle_ms"}, 3);
+	zblock_config.trace_min_cycle_ms = trace_min_cycle_ms.size > 0 ? strtol(trace_min_cycle_ms.start, NULL, 10) : 0;
+	if (zblock_config.trace_min_cycle_ms < 0) zblock_config.trace_min_cycle_ms = 0;
+	
 	return ZBLOCK_CONFIG_OK;
 }
 
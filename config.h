@@ -3,12 +3,32 @@
 
 #include <concord/discord.h>
 
+// limits on concurrent feed downloads used when the config doesn't set them
+#define ZBLOCK_CONFIG_DEFAULT_MAX_CONNECTIONS 64
+#define ZBLOCK_CONFIG_DEFAULT_MAX_HOST_CONNECTIONS 4
+
+// database connections shared by commands and the poller. the poller keeps one for as long as a cycle runs, so there are at least 2.
+#define ZBLOCK_CONFIG_DEFAULT_DB_CONNECTIONS 4
+#define ZBLOCK_CONFIG_MIN_DB_CONNECTIONS 2
+
+// redirects followed when downloading a feed, by the poller and /add alike
+#define ZBLOCK_CONFIG_MAX_REDIRECTS 5
+
+// sent with every feed request. some hosts turn away or throttle requests without one.
+#define ZBLOCK_CONFIG_USER_AGENT "zblock (+https://github.com/WCBROW01/zblock)"
+
 // the current zblock config
 extern struct zblock_config {
 	char *conninfo;
 	u64snowflake tuesday_channel;
 	u64snowflake storytime_channel;
 	bool tuesday_enable;
+	int max_connections; // feed downloads in flight at once
+	int max_host_connections; // feed downloads in flight to a single host
+	int db_connections; // size of the database connection pool
+	char *metrics_file; // where metrics are written for prometheus, NULL if they aren't
+	char *trace_file; // where the trace of a poll cycle is written, NULL if cycles aren't traced
+	int trace_min_cycle_ms; // cycles faster than this aren't written
 } zblock_config;
 
 typedef enum {
@@ -0,0 +1,238 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "date.h"
+
+// the longest name we care about is a month, anything after this many letters is skipped
+#define WORD_LEN 4
+
+static const char MONTHS[12][4] = {
+	"jan", "feb", "mar", "apr", "may", "jun", "jul", "aug", "sep", "oct", "nov", "dec"
+};
+
+// timezone names and their offsets in minutes. anything not in here is treated as UTC.
+static const struct {
+	char name[WORD_LEN + 1];
+	int offset;
+} ZONES[] = {
+	{"ut", 0}, {"utc", 0}, {"gmt", 0}, {"z", 0},
+	{"est", -5 * 60}, {"edt", -4 * 60},
+	{"cst", -6 * 60}, {"cdt", -5 * 60},
+	{"mst", -7 * 60}, {"mdt", -6 * 60},
+	{"pst", -8 * 60}, {"pdt", -7 * 60},
+	{"akst", -9 * 60}, {"akdt", -8 * 60},
+	{"hst", -10 * 60},
+	{"bst", 60}, {"cet", 60}, {"cest", 2 * 60}, {"eet", 2 * 60}, {"eest", 3 * 60},
+	{"msk", 3 * 60}, {"jst", 9 * 60}, {"kst", 9 * 60},
+	{"aest", 10 * 60}, {"aedt", 11 * 60}, {"nzst", 12 * 60}, {"nzdt", 13 * 60}
+};
+
+static inline bool is_digit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+static inline bool is_alpha(char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static inline bool is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static const char *skip_space(const char *s) {
+	while (is_space(*s)) ++s;
+	return s;
+}
+
+// reads at most max_digits digits into value, returns how many were read
+static int read_number(const char **s, int max_digits, int *value) {
+	const char *p = *s;
+	int n = 0, v = 0;
+	for (; n < max_digits && is_digit(*p); ++n, ++p) v = v * 10 + (*p - '0');
+	*s = p;
+	*value = v;
+	return n;
+}
+
+// reads a word as lowercase into buf, only keeping the first WORD_LEN letters. returns the full length.
+static size_t read_word(const char **s, char buf[WORD_LEN + 1]) {
+	const char *p = *s;
+	size_t len = 0;
+	for (; is_alpha(*p); ++p, ++len) {
+		if (len < WORD_LEN) buf[len] = *p | 0x20;
+	}
+	buf[len < WORD_LEN ? len : WORD_LEN] = '\0';
+	*s = p;
+	return len;
+}
+
+// returns the month (1-12) starting with the first three letters of a name, or 0
+static int month_from_name(const char *name) {
+	for (int i = 0; i < 12; ++i) {
+		if (!memcmp(name, MONTHS[i], 3)) return i + 1;
+	}
+	return 0;
+}
+
+static bool is_leap_year(int year) {
+	return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+static int days_in_month(int year, int month) {
+	static const int DAYS[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+	return month == 2 && is_leap_year(year) ? 29 : DAYS[month - 1];
+}
+
+// days between 1970-01-01 and a date in the proleptic gregorian calendar
+static int64_t days_from_civil(int64_t year, int month, int day) {
+	year -= month <= 2;
+	int64_t era = (year >= 0 ? year : year - 399) / 400;
+	int64_t year_of_era = year - era * 400;
+	int64_t day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+	return era * 146097 + day_of_era - 719468;
+}
+
+static time_t make_time(int year, int month, int day, int hour, int minute, int second, int offset) {
+	if (year < 1 || year > 9999 || month < 1 || month > 12 || day < 1 || day > days_in_month(year, month)) return 0;
+	// a leap second is counted as the start of the next minute like timegm does
+	if (hour > 23 || minute > 59 || second > 60) return 0;
+
+	int64_t t = days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second - offset * 60;
+	return (time_t) t;
+}
+
+// reads a numeric offset like +0100, -05:00 or +02 in minutes. returns false if it's not one.
+static bool read_offset(const char **s, int *offset) {
+	const char *p = *s;
+	if (*p != '+' && *p != '-') return false;
+	int sign = *p++ == '-' ? -1 : 1;
+
+	int hours, minutes = 0;
+	int digits = read_number(&p, 4, &hours);
+	if (digits == 4) {
+		minutes = hours % 100;
+		hours /= 100;
+	} else if (digits == 1 || digits == 2) {
+		if (*p == ':' && is_digit(p[1])) {
+			++p;
+			if (read_number(&p, 2, &minutes) != 2) return false;
+		}
+	} else {
+		return false;
+	}
+	if (hours > 23 || minutes > 59) return false;
+
+	*offset = sign * (hours * 60 + minutes);
+	*s = p;
+	return true;
+}
+
+// reads hh:mm[:ss[.fraction]], the fraction is thrown out
+static bool read_time(const char **s, int *hour, int *minute, int *second) {
+	const char *p = *s;
+	if (!read_number(&p, 2, hour) || *p++ != ':' || read_number(&p, 2, minute) != 2) return false;
+	*second = 0;
+	if (*p == ':') {
+		++p;
+		if (read_number(&p, 2, second) != 2) return false;
+		if (*p == '.' || *p == ',') {
+			++p;
+			while (is_digit(*p)) ++p;
+		}
+	}
+	*s = p;
+	return true;
+}
+
+// YYYY-MM-DD[Thh:mm[:ss[.fraction]]][Z|+hh:mm]
+static time_t parse_rfc3339(const char *p) {
+	int year, month, day, hour = 0, minute = 0, second = 0, offset = 0;
+	if (read_number(&p, 4, &year) != 4 || *p++ != '-') return 0;
+	if (read_number(&p, 2, &month) != 2 || *p++ != '-') return 0;
+	if (read_number(&p, 2, &day) != 2) return 0;
+
+	// a date on its own is midnight UTC
+	if (*p == 'T' || *p == 't' || (*p == ' ' && is_digit(p[1]))) {
+		++p;
+		if (!read_time(&p, &hour, &minute, &second)) return 0;
+		p = skip_space(p);
+		if (*p == 'Z' || *p == 'z') {
+			++p;
+		} else if (*p == '+' || *p == '-') {
+			if (!read_offset(&p, &offset)) return 0;
+		}
+		// no timezone at all is taken as UTC
+	}
+
+	return make_time(year, month, day, hour, minute, second, offset);
+}
+
+// [Day,] DD Mon YYYY [hh:mm[:ss]] [zone]
+static time_t parse_rfc822(const char *p) {
+	char word[WORD_LEN + 1];
+
+	// the day name is optional and sometimes written out in full or without the comma
+	if (is_alpha(*p)) {
+		read_word(&p, word);
+		p = skip_space(p);
+		if (*p == ',') p = skip_space(p + 1);
+	}
+
+	int day, month, year, hour = 0, minute = 0, second = 0, offset = 0;
+	if (!read_number(&p, 2, &day)) return 0;
+	// dashes show up in dates written the old RFC 850 way (03-Jun-08)
+	if (*p == '-') ++p;
+	p = skip_space(p);
+	if (read_word(&p, word) < 3 || !(month = month_from_name(word))) return 0;
+	if (*p == '.') ++p; // abbreviations like "Sept."
+	if (*p == '-') ++p;
+	p = skip_space(p);
+
+	int year_digits = read_number(&p, 4, &year);
+	if (year_digits == 2) {
+		year += year < 50 ? 2000 : 1900;
+	} else if (year_digits == 3) {
+		year += 1900;
+	} else if (year_digits != 4) {
+		return 0;
+	}
+	if (*p == ',') ++p;
+	p = skip_space(p);
+
+	// dates without a time are midnight
+	if (is_digit(*p)) {
+		if (!read_time(&p, &hour, &minute, &second)) return 0;
+		p = skip_space(p);
+	}
+
+	if (*p == '+' || *p == '-') {
+		if (!read_offset(&p, &offset)) return 0;
+	} else if (is_alpha(*p)) {
+		size_t len = read_word(&p, word);
+		if (len <= WORD_LEN) {
+			for (size_t i = 0; i < sizeof(ZONES) / sizeof(*ZONES); ++i) {
+				if (!strcmp(word, ZONES[i].name)) {
+					offset = ZONES[i].offset;
+					break;
+				}
+			}
+		}
+		// some feeds write things like GMT+0100
+		int extra_offset;
+		if (read_offset(&p, &extra_offset)) offset += extra_offset;
+	}
+
+	return make_time(year, month, day, hour, minute, second, offset);
+}
+
+time_t zblock_date_parse(const char *s) {
+	if (!s) return 0;
+
+	const char *p = skip_space(s);
+	// RFC 3339 dates are the only ones that start with a four digit year
+	if (is_digit(p[0]) && is_digit(p[1]) && is_digit(p[2]) && is_digit(p[3]) && p[4] == '-') return parse_rfc3339(p);
+	return parse_rfc822(p);
+}
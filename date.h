@@ -0,0 +1,12 @@
+#ifndef ZBLOCK_DATE_H
+#define ZBLOCK_DATE_H
+
+#include <time.h>
+
+/* Parses the date of a feed item, returns 0 if it isn't a date.
+ * Understands RFC 822 dates (RSS) and RFC 3339 dates (Atom), along with the usual ways feeds get them wrong:
+ * missing day names or seconds, full day and month names, two digit years, named or missing timezones, and so on.
+ * Doesn't allocate or depend on the locale. */
+time_t zblock_date_parse(const char *s);
+
+#endif
@@ -0,0 +1,156 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <concord/log.h>
+
+#include <libpq-fe.h>
+
+#include "feed_info.h"
+#include "db_pool.h"
+
+static const char *ZBLOCK_DB_POOL_ERRORS[] = {
+	"OK",
+	"The pool is already running",
+	"Invalid arguments provided",
+	"Out of memory",
+	"Failed to connect to database"
+};
+static_assert(sizeof(ZBLOCK_DB_POOL_ERRORS) / sizeof(*ZBLOCK_DB_POOL_ERRORS) == ZBLOCK_DB_POOL_ERRORCOUNT, "Not all pool errors implemented");
+
+static struct {
+	PGconn **conns; // every connection, for cleanup
+	PGconn **idle; // stack of connections that aren't checked out
+	int size;
+	int nidle;
+	bool running;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER
+};
+
+// connects and gets the connection ready for feed_info
+static PGconn *pool_connect(const char *conninfo) {
+	PGconn *conn = PQconnectdb(conninfo);
+	if (PQstatus(conn) != CONNECTION_OK) {
+		log_error("Failed to connect to database: %s", PQerrorMessage(conn));
+		PQfinish(conn);
+		return NULL;
+	}
+
+	if (zblock_feed_info_prepare(conn)) {
+		PQfinish(conn);
+		return NULL;
+	}
+
+	return conn;
+}
+
+// checks if a connection can be used as is, without a round trip to the server
+static bool conn_healthy(PGconn *conn) {
+	// reading whatever is waiting on the socket notices if the server hung up on us
+	if (PQstatus(conn) == CONNECTION_OK) PQconsumeInput(conn);
+	// anything other than idle means the last user left a query or transaction behind
+	return PQstatus(conn) == CONNECTION_OK && PQtransactionStatus(conn) == PQTRANS_IDLE;
+}
+
+// opens size connections to the database, each with the feed_info statements prepared
+zblock_db_pool_err zblock_db_pool_init(const char *conninfo, int size) {
+	if (!conninfo || size <= 0) return ZBLOCK_DB_POOL_INVALID_ARGS;
+	if (pool.running) return ZBLOCK_DB_POOL_RUNNING;
+
+	pool.conns = calloc(size, sizeof(*pool.conns));
+	pool.idle = calloc(size, sizeof(*pool.idle));
+	if (!pool.conns || !pool.idle) {
+		free(pool.conns);
+		free(pool.idle);
+		return ZBLOCK_DB_POOL_NOMEM;
+	}
+
+	for (int i = 0; i < size; ++i) {
+		pool.conns[i] = pool_connect(conninfo);
+		if (!pool.conns[i]) {
+			for (int j = 0; j < i; ++j) PQfinish(pool.conns[j]);
+			free(pool.conns);
+			free(pool.idle);
+			return ZBLOCK_DB_POOL_CONNECT_ERROR;
+		}
+		pool.idle[i] = pool.conns[i];
+	}
+
+	pool.size = size;
+	pool.nidle = size;
+	pool.running = true;
+	return ZBLOCK_DB_POOL_OK;
+}
+
+/* Takes a connection out of the pool, waiting for one to be checked in if they're all in use.
+ * Connections that have dropped are reset before being handed out.
+ * Returns NULL if the pool isn't running or the database can't be reached. */
+PGconn *zblock_db_pool_checkout(void) {
+	pthread_mutex_lock(&pool.lock);
+	while (pool.running && !pool.nidle) pthread_cond_wait(&pool.cond, &pool.lock);
+	if (!pool.running) {
+		pthread_mutex_unlock(&pool.lock);
+		return NULL;
+	}
+	PGconn *conn = pool.idle[--pool.nidle];
+	pthread_mutex_unlock(&pool.lock);
+
+	// reconnecting happens outside the lock so nobody else has to wait on it
+	if (!conn_healthy(conn)) {
+		log_warn("Lost connection to database, reconnecting...");
+		PQreset(conn);
+		if (PQstatus(conn) != CONNECTION_OK) {
+			log_error("Failed to connect to database: %s", PQerrorMessage(conn));
+			zblock_db_pool_checkin(conn);
+			return NULL;
+		}
+		// prepared statements don't survive a reset
+		if (zblock_feed_info_prepare(conn)) {
+			zblock_db_pool_checkin(conn);
+			return NULL;
+		}
+	}
+
+	return conn;
+}
+
+// returns a connection to the pool
+void zblock_db_pool_checkin(PGconn *conn) {
+	if (!conn) return;
+
+	pthread_mutex_lock(&pool.lock);
+	assert(pool.nidle < pool.size && "More connections checked in than checked out");
+	pool.idle[pool.nidle++] = conn;
+	pthread_cond_signal(&pool.cond);
+	pthread_mutex_unlock(&pool.lock);
+}
+
+// closes every connection. anything that is checked out has to be checked in first.
+void zblock_db_pool_destroy(void) {
+	pthread_mutex_lock(&pool.lock);
+	if (!pool.running) {
+		pthread_mutex_unlock(&pool.lock);
+		return;
+	}
+	pool.running = false;
+	pthread_cond_broadcast(&pool.cond);
+	pthread_mutex_unlock(&pool.lock);
+
+	for (int i = 0; i < pool.size; ++i) PQfinish(pool.conns[i]);
+	free(pool.conns);
+	free(pool.idle);
+	pool.conns = NULL;
+	pool.idle = NULL;
+	pool.size = 0;
+	pool.nidle = 0;
+}
+
+// returns a string about the result of a pool function
+const char *zblock_db_pool_strerror(zblock_db_pool_err error) {
+	return error < 0 || error >= ZBLOCK_DB_POOL_ERRORCOUNT ? "Unspecified error" : ZBLOCK_DB_POOL_ERRORS[error];
+}
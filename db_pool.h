@@ -0,0 +1,32 @@
+#ifndef ZBLOCK_DB_POOL_H
+#define ZBLOCK_DB_POOL_H
+
+#include <libpq-fe.h>
+
+typedef enum {
+	ZBLOCK_DB_POOL_OK,
+	ZBLOCK_DB_POOL_RUNNING,
+	ZBLOCK_DB_POOL_INVALID_ARGS,
+	ZBLOCK_DB_POOL_NOMEM,
+	ZBLOCK_DB_POOL_CONNECT_ERROR,
+	ZBLOCK_DB_POOL_ERRORCOUNT
+} zblock_db_pool_err;
+
+// opens size connections to the database, each with the feed_info statements prepared
+zblock_db_pool_err zblock_db_pool_init(const char *conninfo, int size);
+
+/* Takes a connection out of the pool, waiting for one to be checked in if they're all in use.
+ * Connections that have dropped are reset before being handed out.
+ * Returns NULL if the pool isn't running or the database can't be reached. */
+PGconn *zblock_db_pool_checkout(void);
+
+// returns a connection to the pool
+void zblock_db_pool_checkin(PGconn *conn);
+
+// closes every connection. anything that is checked out has to be checked in first.
+void zblock_db_pool_destroy(void);
+
+// returns a string about the result of a pool function
+const char *zblock_db_pool_strerror(zblock_db_pool_err error);
+
+#endif
@@ -0,0 +1,125 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "db_worker.h"
+
+static const char *ZBLOCK_DB_WORKER_ERRORS[] = {
+	"OK",
+	"The workers are already running",
+	"The workers are not running",
+	"Out of memory",
+	"Unable to create worker thread"
+};
+static_assert(sizeof(ZBLOCK_DB_WORKER_ERRORS) / sizeof(*ZBLOCK_DB_WORKER_ERRORS) == ZBLOCK_DB_WORKER_ERRORCOUNT, "Not all worker errors implemented");
+
+struct job_node {
+	zblock_db_job job;
+	void *data;
+	struct job_node *next;
+};
+
+static struct {
+	pthread_t *threads;
+	int nthreads;
+	struct job_node *head, *tail; // queued jobs, oldest first
+	bool running;
+	bool stop;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} workers = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER
+};
+
+static void *thread_worker(void *arg) {
+	(void) arg;
+
+	pthread_mutex_lock(&workers.lock);
+	for (;;) {
+		while (!workers.head && !workers.stop) pthread_cond_wait(&workers.cond, &workers.lock);
+		// the queue is emptied before stopping
+		if (!workers.head) break;
+
+		struct job_node *node = workers.head;
+		workers.head = node->next;
+		if (!workers.head) workers.tail = NULL;
+		pthread_mutex_unlock(&workers.lock);
+
+		node->job(node->data);
+		free(node);
+
+		pthread_mutex_lock(&workers.lock);
+	}
+	pthread_mutex_unlock(&workers.lock);
+
+	return NULL;
+}
+
+// starts nthreads workers that run queued jobs in the order they were submitted
+zblock_db_worker_err zblock_db_worker_start(int nthreads) {
+	if (workers.running) return ZBLOCK_DB_WORKER_RUNNING;
+	if (nthreads < 1) nthreads = 1;
+
+	workers.threads = malloc(nthreads * sizeof(*workers.threads));
+	if (!workers.threads) return ZBLOCK_DB_WORKER_NOMEM;
+
+	workers.stop = false;
+	for (workers.nthreads = 0; workers.nthreads < nthreads; ++workers.nthreads) {
+		if (pthread_create(&workers.threads[workers.nthreads], NULL, &thread_worker, NULL)) {
+			// take down the ones that did start
+			zblock_db_worker_stop();
+			return ZBLOCK_DB_WORKER_THREAD_ERROR;
+		}
+	}
+
+	workers.running = true;
+	return ZBLOCK_DB_WORKER_OK;
+}
+
+/* Queues a job so gateway event handlers can return right away instead of waiting on the database.
+ * If this fails the job is not run and data still belongs to the caller. */
+zblock_db_worker_err zblock_db_worker_submit(zblock_db_job job, void *data) {
+	struct job_node *node = malloc(sizeof(*node));
+	if (!node) return ZBLOCK_DB_WORKER_NOMEM;
+	*node = (struct job_node) {
+		.job = job,
+		.data = data
+	};
+
+	pthread_mutex_lock(&workers.lock);
+	if (!workers.running || workers.stop) {
+		pthread_mutex_unlock(&workers.lock);
+		free(node);
+		return ZBLOCK_DB_WORKER_NOT_RUNNING;
+	}
+	if (workers.tail) workers.tail->next = node;
+	else workers.head = node;
+	workers.tail = node;
+	pthread_cond_signal(&workers.cond);
+	pthread_mutex_unlock(&workers.lock);
+
+	return ZBLOCK_DB_WORKER_OK;
+}
+
+// runs every job that is still queued, then stops the workers
+void zblock_db_worker_stop(void) {
+	if (!workers.threads) return;
+
+	pthread_mutex_lock(&workers.lock);
+	workers.stop = true;
+	pthread_cond_broadcast(&workers.cond);
+	pthread_mutex_unlock(&workers.lock);
+
+	for (int i = 0; i < workers.nthreads; ++i) pthread_join(workers.threads[i], NULL);
+	free(workers.threads);
+	workers.threads = NULL;
+	workers.nthreads = 0;
+	workers.running = false;
+}
+
+// returns a string about the result of a worker function
+const char *zblock_db_worker_strerror(zblock_db_worker_err error) {
+	return error < 0 || error >= ZBLOCK_DB_WORKER_ERRORCOUNT ? "Unspecified error" : ZBLOCK_DB_WORKER_ERRORS[error];
+}
@@ -0,0 +1,29 @@
+#ifndef ZBLOCK_DB_WORKER_H
+#define ZBLOCK_DB_WORKER_H
+
+// a job run on a worker thread. it owns data and checks out its own database connection from the pool.
+typedef void (*zblock_db_job)(void *data);
+
+typedef enum {
+	ZBLOCK_DB_WORKER_OK,
+	ZBLOCK_DB_WORKER_RUNNING,
+	ZBLOCK_DB_WORKER_NOT_RUNNING,
+	ZBLOCK_DB_WORKER_NOMEM,
+	ZBLOCK_DB_WORKER_THREAD_ERROR,
+	ZBLOCK_DB_WORKER_ERRORCOUNT
+} zblock_db_worker_err;
+
+// starts nthreads workers that run queued jobs in the order they were submitted
+zblock_db_worker_err zblock_db_worker_start(int nthreads);
+
+/* Queues a job so gateway event handlers can return right away instead of waiting on the database.
+ * If this fails the job is not run and data still belongs to the caller. */
+zblock_db_worker_err zblock_db_worker_submit(zblock_db_job job, void *data);
+
+// runs every job that is still queued, then stops the workers
+void zblock_db_worker_stop(void);
+
+// returns a string about the result of a worker function
+const char *zblock_db_worker_strerror(zblock_db_worker_err error);
+
+#endif
@@ -0,0 +1,261 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <curl/curl.h>
+
+#include <concord/log.h>
+
+#include "config.h"
+#include "feed_parser.h"
+#include "date.h"
+#include "feed_fetch.h"
+
+static const char *ZBLOCK_FEED_FETCH_ERRORS[] = {
+	"OK",
+	"The fetch thread is already running",
+	"The fetch thread is not running",
+	"Out of memory",
+	"Unable to create curl multi handle",
+	"Unable to create fetch thread"
+};
+static_assert(sizeof(ZBLOCK_FEED_FETCH_ERRORS) / sizeof(*ZBLOCK_FEED_FETCH_ERRORS) == ZBLOCK_FEED_FETCH_ERRORCOUNT, "Not all fetch errors implemented");
+
+// one feed being fetched
+struct fetch_request {
+	char *url;
+	zblock_feed_fetch_callback callback;
+	void *userdata;
+	CURL *handle;
+	zblock_feed_parser parser;
+	time_t last_pubDate;
+	char error[CURL_ERROR_SIZE];
+	struct fetch_request *next; // next request waiting to be started, or next one in flight
+};
+
+static struct {
+	CURLM *multi;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	struct fetch_request *head, *tail; // requests waiting to be started, oldest first
+	struct fetch_request *active; // requests in flight, only touched by the fetch thread
+	bool running;
+	bool stop;
+} fetcher = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+// calls back with the result of a request and frees it
+static void fetch_request_finish(struct fetch_request *req, const char *error) {
+	zblock_feed_fetch_result result = {
+		.error = error,
+		.last_pubDate = req->last_pubDate
+	};
+	strcpy(result.title, req->parser.title);
+	req->callback(req->userdata, &result);
+
+	if (req->handle) {
+		for (struct fetch_request **active = &fetcher.active; *active; active = &(*active)->next) {
+			if (*active == req) {
+				*active = req->next;
+				break;
+			}
+		}
+		curl_multi_remove_handle(fetcher.multi, req->handle);
+		curl_easy_cleanup(req->handle);
+	}
+	free(req->url);
+	free(req);
+}
+
+static bool fetch_item_callback(void *userdata, const zblock_feed_entry *entry) {
+	struct fetch_request *req = userdata;
+	time_t pubDate = zblock_date_parse(entry->pubDate);
+	if (pubDate > req->last_pubDate) req->last_pubDate = pubDate;
+	// the newest item is normally first, so only keep going if the title hasn't shown up yet
+	return !*req->parser.title;
+}
+
+static size_t fetch_write_callback(char *data, size_t size, size_t nmemb, void *userdata) {
+	struct fetch_request *req = userdata;
+	size_t data_size = size * nmemb;
+
+	// don't bother parsing error pages
+	long response_code = 0;
+	curl_easy_getinfo(req->handle, CURLINFO_RESPONSE_CODE, &response_code);
+	if (response_code >= 300) return data_size;
+
+	if (zblock_feed_parser_parse(&req->parser, data, data_size) == ZBLOCK_FEED_PARSER_STOPPED) return 0;
+	return data_size;
+}
+
+// adds a request to the multi handle, finishing it right away on failure
+static void fetch_request_start(struct fetch_request *req) {
+	zblock_feed_parser_init(&req->parser, &fetch_item_callback, req);
+
+	req->handle = curl_easy_init();
+	if (!req->handle) {
+		fetch_request_finish(req, "Unable to create curl handle");
+		return;
+	}
+
+	curl_easy_setopt(req->handle, CURLOPT_URL, req->url);
+	curl_easy_setopt(req->handle, CURLOPT_WRITEFUNCTION, &fetch_write_callback);
+	curl_easy_setopt(req->handle, CURLOPT_WRITEDATA, req);
+	curl_easy_setopt(req->handle, CURLOPT_PRIVATE, req);
+	curl_easy_setopt(req->handle, CURLOPT_ERRORBUFFER, req->error);
+	curl_easy_setopt(req->handle, CURLOPT_TIMEOUT, (long) ZBLOCK_FEED_FETCH_TIMEOUT);
+	curl_easy_setopt(req->handle, CURLOPT_USERAGENT, ZBLOCK_CONFIG_USER_AGENT);
+	// follow redirects the same way the poller does, so anything that can be added can also be polled
+	curl_easy_setopt(req->handle, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(req->handle, CURLOPT_MAXREDIRS, (long) ZBLOCK_CONFIG_MAX_REDIRECTS);
+	// the url isn't trusted, so don't go anywhere a feed wouldn't be, redirects included
+	curl_easy_setopt(req->handle, CURLOPT_PROTOCOLS_STR, "http,https");
+	curl_easy_setopt(req->handle, CURLOPT_REDIR_PROTOCOLS_STR, "http,https");
+	CURLMcode mc = curl_multi_add_handle(fetcher.multi, req->handle);
+	if (mc) {
+		curl_easy_cleanup(req->handle);
+		req->handle = NULL;
+		fetch_request_finish(req, curl_multi_strerror(mc));
+		return;
+	}
+
+	req->next = fetcher.active;
+	fetcher.active = req;
+}
+
+// checks how a finished transfer went and calls back with the result
+static void fetch_request_done(struct fetch_request *req, CURLcode result) {
+	// the transfer is cut short on purpose once the parser has what it needs
+	if (result == CURLE_WRITE_ERROR && req->parser.stopped) result = CURLE_OK;
+	if (result) {
+		fetch_request_finish(req, *req->error ? req->error : curl_easy_strerror(result));
+		return;
+	}
+
+	long response_code = 0;
+	curl_easy_getinfo(req->handle, CURLINFO_RESPONSE_CODE, &response_code);
+	if (response_code >= 300) {
+		snprintf(req->error, sizeof(req->error), "HTTP status %ld", response_code);
+		fetch_request_finish(req, req->error);
+		return;
+	}
+
+	zblock_feed_parser_err parser_err = zblock_feed_parser_finish(&req->parser);
+	if (parser_err == ZBLOCK_FEED_PARSER_OK || parser_err == ZBLOCK_FEED_PARSER_STOPPED) {
+		fetch_request_finish(req, NULL);
+	} else {
+		fetch_request_finish(req, zblock_feed_parser_strerror(parser_err));
+	}
+}
+
+static void *thread_fetcher(void *arg) {
+	(void) arg;
+
+	for (;;) {
+		// start everything that was submitted since last time
+		pthread_mutex_lock(&fetcher.lock);
+		bool stop = fetcher.stop;
+		struct fetch_request *pending = fetcher.head;
+		fetcher.head = fetcher.tail = NULL;
+		pthread_mutex_unlock(&fetcher.lock);
+
+		while (pending) {
+			struct fetch_request *req = pending;
+			pending = req->next;
+			if (stop) fetch_request_finish(req, "The bot is shutting down");
+			else fetch_request_start(req);
+		}
+		if (stop) break;
+
+		int running_handles;
+		CURLMcode mc = curl_multi_perform(fetcher.multi, &running_handles);
+		CURLMsg *msg;
+		int msgs_in_queue;
+		while ((msg = curl_multi_info_read(fetcher.multi, &msgs_in_queue))) {
+			if (msg->msg != CURLMSG_DONE) continue;
+			struct fetch_request *req;
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &req);
+			fetch_request_done(req, msg->data.result);
+		}
+
+		// sleeps until there's network activity or zblock_feed_fetch wakes us up
+		if (!mc) mc = curl_multi_poll(fetcher.multi, NULL, 0, 1000, NULL);
+		if (mc) log_error("curl_multi_poll(): %s", curl_multi_strerror(mc));
+	}
+
+	// anything still in flight won't be finished
+	while (fetcher.active) fetch_request_finish(fetcher.active, "The bot is shutting down");
+
+	return NULL;
+}
+
+// starts the thread that runs one-off feed fetches
+zblock_feed_fetch_err zblock_feed_fetch_start(void) {
+	if (fetcher.running) return ZBLOCK_FEED_FETCH_RUNNING;
+
+	fetcher.multi = curl_multi_init();
+	if (!fetcher.multi) return ZBLOCK_FEED_FETCH_CURL_ERROR;
+
+	fetcher.stop = false;
+	if (pthread_create(&fetcher.thread, NULL, &thread_fetcher, NULL)) {
+		curl_multi_cleanup(fetcher.multi);
+		return ZBLOCK_FEED_FETCH_THREAD_ERROR;
+	}
+
+	fetcher.running = true;
+	return ZBLOCK_FEED_FETCH_OK;
+}
+
+/* Fetches and parses a feed without blocking the caller. Any number of fetches can run at once.
+ * The callback is always called exactly once unless this returns an error. */
+zblock_feed_fetch_err zblock_feed_fetch(const char *url, zblock_feed_fetch_callback callback, void *userdata) {
+	struct fetch_request *req = calloc(1, sizeof(*req));
+	if (!req) return ZBLOCK_FEED_FETCH_NOMEM;
+	req->url = strdup(url);
+	if (!req->url) {
+		free(req);
+		return ZBLOCK_FEED_FETCH_NOMEM;
+	}
+	req->callback = callback;
+	req->userdata = userdata;
+
+	pthread_mutex_lock(&fetcher.lock);
+	if (!fetcher.running || fetcher.stop) {
+		pthread_mutex_unlock(&fetcher.lock);
+		free(req->url);
+		free(req);
+		return ZBLOCK_FEED_FETCH_NOT_RUNNING;
+	}
+	if (fetcher.tail) fetcher.tail->next = req;
+	else fetcher.head = req;
+	fetcher.tail = req;
+	// still under the lock so the multi handle can't be cleaned up underneath us
+	curl_multi_wakeup(fetcher.multi);
+	pthread_mutex_unlock(&fetcher.lock);
+
+	return ZBLOCK_FEED_FETCH_OK;
+}
+
+// stops the fetch thread. fetches that haven't finished are called back with an error.
+void zblock_feed_fetch_stop(void) {
+	if (!fetcher.running) return;
+
+	pthread_mutex_lock(&fetcher.lock);
+	fetcher.stop = true;
+	curl_multi_wakeup(fetcher.multi);
+	pthread_mutex_unlock(&fetcher.lock);
+
+	pthread_join(fetcher.thread, NULL);
+	curl_multi_cleanup(fetcher.multi);
+	fetcher.running = false;
+}
+
+// returns a string about the result of a fetch function
+const char *zblock_feed_fetch_strerror(zblock_feed_fetch_err error) {
+	return error < 0 || error >= ZBLOCK_FEED_FETCH_ERRORCOUNT ? "Unspecified error" : ZBLOCK_FEED_FETCH_ERRORS[error];
+}
@@ -0,0 +1,43 @@
+#ifndef ZBLOCK_FEED_FETCH_H
+#define ZBLOCK_FEED_FETCH_H
+
+#include <time.h>
+
+#include "feed_parser.h"
+
+// how long a single fetch may take before giving up (in seconds)
+#define ZBLOCK_FEED_FETCH_TIMEOUT 15
+
+typedef struct {
+	const char *error; // NULL if the feed was fetched and parsed
+	char title[ZBLOCK_FEED_PARSER_TITLE_LEN]; // empty if the feed doesn't have one
+	time_t last_pubDate; // date of the newest item, 0 if there are none
+} zblock_feed_fetch_result;
+
+// called on the fetch thread once a feed has been fetched or has failed. the result is only valid during the call.
+typedef void (*zblock_feed_fetch_callback)(void *userdata, const zblock_feed_fetch_result *result);
+
+typedef enum {
+	ZBLOCK_FEED_FETCH_OK,
+	ZBLOCK_FEED_FETCH_RUNNING,
+	ZBLOCK_FEED_FETCH_NOT_RUNNING,
+	ZBLOCK_FEED_FETCH_NOMEM,
+	ZBLOCK_FEED_FETCH_CURL_ERROR,
+	ZBLOCK_FEED_FETCH_THREAD_ERROR,
+	ZBLOCK_FEED_FETCH_ERRORCOUNT
+} zblock_feed_fetch_err;
+
+// starts the thread that runs one-off feed fetches
+zblock_feed_fetch_err zblock_feed_fetch_start(void);
+
+/* Fetches and parses a feed without blocking the caller. Any number of fetches can run at once.
+ * The callback is always called exactly once unless this returns an error. */
+zblock_feed_fetch_err zblock_feed_fetch(const char *url, zblock_feed_fetch_callback callback, void *userdata);
+
+// stops the fetch thread. fetches that haven't finished are called back with an error.
+void zblock_feed_fetch_stop(void);
+
+// returns a string about the result of a fetch function
+const char *zblock_feed_fetch_strerror(zblock_feed_fetch_err error);
+
+#endif
@@ -17,6 +17,12 @@
 
 #include "config.h"
 #include "feed_info.h"
+#include "metrics.h"
+#include "schedule.h"
+#include "date.h"
+
+#define ZBLOCK_XSTR(x) #x
+#define ZBLOCK_STR(x) ZBLOCK_XSTR(x)
 
 static const char *ZBLOCK_FEED_INFO_ERRORS[] = {
 	"OK",
@@ -29,9 +35,63 @@ static const char *ZBLOCK_FEED_INFO_ERRORS[] = {
 };
 static_assert(sizeof(ZBLOCK_FEED_INFO_ERRORS) / sizeof(*ZBLOCK_FEED_INFO_ERRORS) == ZBLOCK_FEED_INFO_ERRORCOUNT, "Not all feed info errors implemented");
 
+// every statement used after startup. they are prepared once per connection by zblock_feed_info_prepare.
+typedef enum {
+	STMT_RETRIEVE_LIST,
+	STMT_EXISTS,
+	STMT_INSERT,
+	STMT_DELETE,
+	STMT_DELETE_ALL_GUILD,
+	STMT_DELETE_ALL_CHANNEL,
+	STMT_UPDATE,
+	STMT_UPDATE_CACHE,
+	STMT_UPDATE_SCHEDULE,
+	STMT_UPDATE_HASH,
+	STMT_COUNT_CHANNEL,
+	STMT_RETRIEVE_PAGE_AFTER,
+	STMT_RETRIEVE_PAGE_BEFORE,
+	STMT_COUNT
+} feed_info_stmt;
+
+static const struct {
+	const char *name;
+	const char *sql;
+} STATEMENTS[] = {
+	[STMT_RETRIEVE_LIST] = {"zblock_retrieve_list",
+		"SELECT url, last_pubDate, channel_id, etag, last_modified, poll_interval, content_hash FROM feeds WHERE next_poll <= now() ORDER BY url"},
+	[STMT_EXISTS] = {"zblock_exists",
+		"SELECT COUNT(1) FROM feeds WHERE url = $1 AND channel_id = $2::bigint"},
+	[STMT_INSERT] = {"zblock_insert",
+		"INSERT INTO feeds (url, last_pubDate, channel_id, title, guild_id) VALUES ($1, $2::timestamptz, $3::bigint, $4, $5::bigint) "
+		"ON CONFLICT (url, channel_id) DO NOTHING"},
+	[STMT_DELETE] = {"zblock_delete",
+		"DELETE FROM feeds WHERE url = $1 AND channel_id = $2::bigint"},
+	[STMT_DELETE_ALL_GUILD] = {"zblock_delete_all_guild",
+		"DELETE FROM feeds WHERE guild_id = $1::bigint"},
+	[STMT_DELETE_ALL_CHANNEL] = {"zblock_delete_all_channel",
+		"DELETE FROM feeds WHERE channel_id = $1::bigint"},
+	[STMT_UPDATE] = {"zblock_update",
+		"UPDATE feeds SET last_pubDate = $1::timestamptz WHERE url = $2 AND channel_id = $3::bigint AND (last_pubDate IS NULL OR last_pubDate < $1::timestamptz)"},
+	[STMT_UPDATE_CACHE] = {"zblock_update_cache",
+		"UPDATE feeds SET etag = $1, last_modified = $2 WHERE url = $3"},
+	[STMT_UPDATE_SCHEDULE] = {"zblock_update_schedule",
+		"UPDATE feeds SET poll_interval = $1::integer, next_poll = now() + $1::integer * interval '1 second' WHERE url = $2"},
+	[STMT_UPDATE_HASH] = {"zblock_update_hash",
+		"UPDATE feeds SET content_hash = $1::bigint WHERE url = $2"},
+	[STMT_COUNT_CHANNEL] = {"zblock_count_channel",
+		"SELECT COUNT(*) FROM feeds WHERE channel_id = $1::bigint"},
+	// both walk feeds_channel_id_idx, so every page costs the same no matter how far in it is
+	[STMT_RETRIEVE_PAGE_AFTER] = {"zblock_retrieve_page_after",
+		"SELECT id, url, last_pubDate, channel_id, title, guild_id FROM feeds WHERE channel_id = $1::bigint AND id > $2::bigint ORDER BY id LIMIT $3::bigint"},
+	[STMT_RETRIEVE_PAGE_BEFORE] = {"zblock_retrieve_page_before",
+		"SELECT id, url, last_pubDate, channel_id, title, guild_id FROM feeds WHERE channel_id = $1::bigint AND id < $2::bigint ORDER BY id DESC LIMIT $3::bigint"}
+};
+static_assert(sizeof(STATEMENTS) / sizeof(*STATEMENTS) == STMT_COUNT, "Not all feed info statements implemented");
+
 // free all information associated with a minimal feed info struct (does not assume the struct was allocated using malloc)
 void zblock_feed_info_minimal_free(zblock_feed_info_minimal *feed_info) {
-	free(feed_info->last_pubDate);
+	free(feed_info->last_modified);
+	free(feed_info->etag);
 	free(feed_info->url);
 }
 
@@ -46,25 +106,183 @@ const char *zblock_feed_info_strerror(zblock_feed_info_err error) {
 	return error < 0 || error >= ZBLOCK_FEED_INFO_ERRORCOUNT ? "Unspecified error" : ZBLOCK_FEED_INFO_ERRORS[error];
 }
 
-time_t pubDate_to_time_t(char *s) {
-	struct tm tm;
+// postgres sends timestamps in binary as microseconds since 2000-01-01 00:00:00 UTC
+#define PG_EPOCH_OFFSET 946684800
+
+static uint64_t time_t_to_pg_be(time_t t) {
+	return htobe64((uint64_t) (((int64_t) t - PG_EPOCH_OFFSET) * 1000000));
+}
+
+static time_t pg_to_time_t(const char *value) {
+	int64_t usec = (int64_t) be64toh(*(uint64_t *) value);
+	// round down for dates before 2000
+	return (usec < 0 ? (usec - 999999) / 1000000 : usec / 1000000) + PG_EPOCH_OFFSET;
+}
+
+// reads a last_pubDate column, which is null if nothing has been sent yet
+static time_t get_last_pubDate(const PGresult *res, int row, int column) {
+	return PQgetisnull(res, row, column) ? 0 : pg_to_time_t(PQgetvalue(res, row, column));
+}
+
+/* Older databases stored last_pubDate as the pubDate string itself.
+ * Convert it to a timestamp once, parsing the old strings here since postgres doesn't understand all of them. */
+static zblock_feed_info_err migrate_last_pubDate(PGconn *conn) {
+	PGresult *res = PQexec(conn,
+		"SELECT 1 FROM information_schema.columns "
+		"WHERE table_schema = current_schema() AND table_name = 'feeds' AND column_name = 'last_pubdate' AND data_type = 'text'"
+	);
+	if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+		log_error(PQresultErrorMessage(res));
+		PQclear(res);
+		return ZBLOCK_FEED_INFO_DBERROR;
+	}
+	int needs_migration = PQntuples(res);
+	PQclear(res);
+	if (!needs_migration) return ZBLOCK_FEED_INFO_OK;
+	
+	log_info("Converting last_pubDate to timestamps...");
+	res = PQexec(conn,
+		"BEGIN;"
+		"ALTER TABLE feeds RENAME COLUMN last_pubDate TO last_pubDate_text;"
+		"ALTER TABLE feeds ADD COLUMN last_pubDate timestamptz"
+	);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK) goto fail;
+	PQclear(res);
+	
+	res = PQexec(conn, "SELECT url, channel_id, last_pubDate_text FROM feeds WHERE last_pubDate_text IS NOT NULL");
+	if (PQresultStatus(res) != PGRES_TUPLES_OK) goto fail;
+	
+	int nfeeds = PQntuples(res);
+	for (int i = 0; i < nfeeds; ++i) {
+		// anything that can't be parsed (like "Never") is left null
+		time_t last_pubDate = zblock_date_parse(PQgetvalue(res, i, 2));
+		if (!last_pubDate) continue;
+		
+		uint64_t last_pubDate_be = time_t_to_pg_be(last_pubDate);
+		const char *const params[] = {(char *) &last_pubDate_be, PQgetvalue(res, i, 0), PQgetvalue(res, i, 1)};
+		const int param_lengths[] = {sizeof(last_pubDate_be), 0, 0};
+		const int param_formats[] = {1, 0, 0};
+		PGresult *update_res = PQexecParams(conn,
+			"UPDATE feeds SET last_pubDate = $1::timestamptz WHERE url = $2 AND channel_id = $3::bigint",
+			3, NULL, params, param_lengths, param_formats, 1
+		);
+		if (PQresultStatus(update_res) != PGRES_COMMAND_OK) {
+			PQclear(res);
+			res = update_res;
+			goto fail;
+		}
+		PQclear(update_res);
+	}
+	PQclear(res);
+	
+	res = PQexec(conn, "ALTER TABLE feeds DROP COLUMN last_pubDate_text; COMMIT");
+	if (PQresultStatus(res) != PGRES_COMMAND_OK) goto fail;
+	PQclear(res);
+	return ZBLOCK_FEED_INFO_OK;
+	
+	fail:
+	log_error(PQresultErrorMessage(res));
+	PQclear(res);
+	PQclear(PQexec(conn, "ROLLBACK"));
+	return ZBLOCK_FEED_INFO_DBERROR;
+}
+
+/* Two /adds of the same feed could both pass the check before either inserts, so (url, channel_id) is made unique.
+ * Any duplicates that already got in are removed first, keeping the oldest subscription. */
+static zblock_feed_info_err migrate_unique(PGconn *conn) {
+	PGresult *res = PQexec(conn, "SELECT to_regclass('feeds_url_channel_id_idx') IS NULL");
+	if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+		log_error(PQresultErrorMessage(res));
+		PQclear(res);
+		return ZBLOCK_FEED_INFO_DBERROR;
+	}
+	int needs_migration = *PQgetvalue(res, 0, 0) == 't';
+	PQclear(res);
+	if (!needs_migration) return ZBLOCK_FEED_INFO_OK;
+	
+	log_info("Removing duplicate feeds...");
+	// sent together, so they run in one transaction
+	res = PQexec(conn,
+		"DELETE FROM feeds a USING feeds b WHERE a.url = b.url AND a.channel_id = b.channel_id AND a.id > b.id;"
+		"CREATE UNIQUE INDEX feeds_url_channel_id_idx ON feeds (url, channel_id)"
+	);
+	zblock_feed_info_err result = ZBLOCK_FEED_INFO_OK;
+	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+		log_error(PQresultErrorMessage(res));
+		result = ZBLOCK_FEED_INFO_DBERROR;
+	}
+	
+	PQclear(res);
+	return result;
+}
+
+// add any columns missing from the feeds table. should be called once at startup.
+zblock_feed_info_err zblock_feed_info_migrate(PGconn *conn) {
+	if (!conn) return ZBLOCK_FEED_INFO_INVALID_ARGS;
+	
+	zblock_feed_info_err pubDate_result = migrate_last_pubDate(conn);
+	if (pubDate_result) return pubDate_result;
+	
+	PGresult *res = PQexec(conn,
+		"ALTER TABLE feeds ADD COLUMN IF NOT EXISTS etag text, ADD COLUMN IF NOT EXISTS last_modified text, "
+		"ADD COLUMN IF NOT EXISTS next_poll timestamptz NOT NULL DEFAULT now(), "
+		"ADD COLUMN IF NOT EXISTS poll_interval integer NOT NULL DEFAULT " ZBLOCK_STR(ZBLOCK_SCHEDULE_DEFAULT_INTERVAL) ", "
+		"ADD COLUMN IF NOT EXISTS id bigserial, "
+		"ADD COLUMN IF NOT EXISTS content_hash bigint;"
+		"CREATE INDEX IF NOT EXISTS feeds_next_poll_idx ON feeds (next_poll);"
+		"CREATE INDEX IF NOT EXISTS feeds_channel_id_idx ON feeds (channel_id, id)"
+	);
+	
+	zblock_feed_info_err result = ZBLOCK_FEED_INFO_OK;
+	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+		log_error(PQresultErrorMessage(res));
+		result = ZBLOCK_FEED_INFO_DBERROR;
+	}
+	
+	PQclear(res);
+	return result ? result : migrate_unique(conn);
+}
+
+// prepares every statement on a connection. call this after connecting and after every reset.
+zblock_feed_info_err zblock_feed_info_prepare(PGconn *conn) {
+	if (!conn) return ZBLOCK_FEED_INFO_INVALID_ARGS;
+	
+	// start over in case some of them are already there
+	PGresult *res = PQexec(conn, "DEALLOCATE ALL");
+	PQclear(res);
 	
-	// time format with e.g. +0000
-	if (!strptime(s, "%a, %d %b %Y %T %z", &tm)) { // try the other time format with timezone
-		if(!strptime(s, "%a, %d %b %Y %T %Z", &tm)) return 0; // invalid time
+	for (int i = 0; i < STMT_COUNT; ++i) {
+		res = PQprepare(conn, STATEMENTS[i].name, STATEMENTS[i].sql, 0, NULL);
+		if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+			log_error("Unable to prepare %s: %s", STATEMENTS[i].name, PQresultErrorMessage(res));
+			PQclear(res);
+			return ZBLOCK_FEED_INFO_DBERROR;
+		}
+		PQclear(res);
 	}
 	
-	return timegm(&tm);
+	return ZBLOCK_FEED_INFO_OK;
+}
+
+// runs a prepared statement. if the connection was reset and lost its statements, they're prepared again and it's retried.
+static PGresult *exec_stmt(PGconn *conn, feed_info_stmt stmt, int nparams, const char *const *values, const int *lengths, const int *formats) {
+	uint64_t start = zblock_metrics_now();
+	PGresult *res = PQexecPrepared(conn, STATEMENTS[stmt].name, nparams, values, lengths, formats, 1);
+	const char *sqlstate = PQresultErrorField(res, PG_DIAG_SQLSTATE);
+	// 26000 is invalid_sql_statement_name
+	if (sqlstate && !strcmp(sqlstate, "26000") && !zblock_feed_info_prepare(conn)) {
+		PQclear(res);
+		res = PQexecPrepared(conn, STATEMENTS[stmt].name, nparams, values, lengths, formats, 1);
+	}
+	zblock_metrics_observe_since(ZBLOCK_METRIC_DB_QUERY_DURATION, start);
+	return res;
 }
 
-// Begin retrieval of feed info objects.
+// Begin retrieval of feed info objects that are due to be polled. Rows with the same url are returned next to each other.
 zblock_feed_info_err zblock_feed_info_retrieve_list_begin(PGconn *conn) {
 	if (!conn) return ZBLOCK_FEED_INFO_INVALID_ARGS;
 
-	if (!PQsendQueryParams(
-		conn, "SELECT url, last_pubDate, channel_id from feeds",
-		0, NULL, NULL, NULL, NULL, 1
-	)) {
+	if (!PQsendQueryPrepared(conn, STATEMENTS[STMT_RETRIEVE_LIST].name, 0, NULL, NULL, NULL, 1)) {
 		return ZBLOCK_FEED_INFO_DBERROR;
 	}
 	PQsetSingleRowMode(conn);
@@ -92,12 +310,19 @@ zblock_feed_info_err zblock_feed_info_retrieve_list_item(PGconn *conn, zblock_fe
 	}
 
 	feed_info->url = strdup(PQgetvalue(res, 0, 0));
-	feed_info->last_pubDate = strdup(PQgetvalue(res, 0, 1));
-	if (!feed_info->url || !feed_info->last_pubDate) {
+	feed_info->last_pubDate = get_last_pubDate(res, 0, 1);
+	feed_info->etag = PQgetisnull(res, 0, 3) ? NULL : strdup(PQgetvalue(res, 0, 3));
+	feed_info->last_modified = PQgetisnull(res, 0, 4) ? NULL : strdup(PQgetvalue(res, 0, 4));
+	if (!feed_info->url
+		|| (!PQgetisnull(res, 0, 3) && !feed_info->etag)
+		|| (!PQgetisnull(res, 0, 4) && !feed_info->last_modified)) {
 		PQclear(res);
+		zblock_feed_info_minimal_free(feed_info);
 		return ZBLOCK_FEED_INFO_NOMEM;
 	}
 	feed_info->channel_id = be64toh(*(uint64_t *) PQgetvalue(res, 0, 2));
+	feed_info->poll_interval = (int32_t) be32toh(*(uint32_t *) PQgetvalue(res, 0, 5));
+	feed_info->content_hash = PQgetisnull(res, 0, 6) ? 0 : be64toh(*(uint64_t *) PQgetvalue(res, 0, 6));
 	
 	PQclear(res);
 	return ZBLOCK_FEED_INFO_OK;
@@ -111,10 +336,7 @@ zblock_feed_info_err zblock_feed_info_exists(PGconn *conn, const char *url, u64s
 	const char *const params[] = {url, (char *) &channel_id_be};
 	const int param_lengths[] = {0, sizeof(channel_id_be)};
 	const int param_formats[] = {0, 1};
-	PGresult *res = PQexecParams(conn,
-		"SELECT COUNT(1) FROM feeds WHERE url = $1 AND channel_id = $2::bigint",
-		2, NULL, params, param_lengths, param_formats, 1
-	);
+	PGresult *res = exec_stmt(conn, STMT_EXISTS, 2, params, param_lengths, param_formats);
 	if (PQresultStatus(res) != PGRES_TUPLES_OK) {
 		log_error(PQresultErrorMessage(res));
 		PQclear(res);
@@ -126,24 +348,26 @@ zblock_feed_info_err zblock_feed_info_exists(PGconn *conn, const char *url, u64s
 	return ZBLOCK_FEED_INFO_OK;
 }
 
-// Insert new feed into the database. This function assumes that you have already verified that it has not been added previously.
+// Insert new feed into the database. Returns ZBLOCK_FEED_INFO_EXISTS if the channel already has it.
 zblock_feed_info_err zblock_feed_info_insert(PGconn *conn, zblock_feed_info *feed) {
 	if (!conn || !feed) return ZBLOCK_FEED_INFO_INVALID_ARGS;
 
 	uint64_t channel_id_be = htobe64(feed->channel_id);
 	uint64_t guild_id_be = htobe64(feed->guild_id);
-	const char *const insert_params[] = {feed->url, feed->last_pubDate, (char *) &channel_id_be, feed->title, (char *) &guild_id_be};
-	const int param_lengths[] = {0, 0, sizeof(channel_id_be), 0, sizeof(guild_id_be)};
-	const int param_formats[] = {0, 0, 1, 0, 1};
-	PGresult *insert_res = PQexecParams(conn,
-		"INSERT INTO feeds (url, last_pubDate, channel_id, title, guild_id) VALUES ($1, $2, $3::bigint, $4, $5::bigint)",
-		5, NULL, insert_params, param_lengths, param_formats, 1
-	);
+	uint64_t last_pubDate_be = time_t_to_pg_be(feed->last_pubDate);
+	// a feed without any items yet is stored as null
+	const char *const insert_params[] = {feed->url, feed->last_pubDate ? (char *) &last_pubDate_be : NULL, (char *) &channel_id_be, feed->title, (char *) &guild_id_be};
+	const int param_lengths[] = {0, sizeof(last_pubDate_be), sizeof(channel_id_be), 0, sizeof(guild_id_be)};
+	const int param_formats[] = {0, 1, 1, 0, 1};
+	PGresult *insert_res = exec_stmt(conn, STMT_INSERT, 5, insert_params, param_lengths, param_formats);
 	
 	zblock_feed_info_err result = ZBLOCK_FEED_INFO_OK;
 	if (PQresultStatus(insert_res) != PGRES_COMMAND_OK) {
 		log_error(PQresultErrorMessage(insert_res));
 		result = ZBLOCK_FEED_INFO_DBERROR;
+	} else if (!strcmp(PQcmdTuples(insert_res), "0")) {
+		// someone else added it since it was checked
+		result = ZBLOCK_FEED_INFO_EXISTS;
 	}
 	
 	PQclear(insert_res);
@@ -169,10 +393,7 @@ zblock_feed_info_err zblock_feed_info_delete(PGconn *conn, const char *url, u64s
 	const char *const params[] = {url, (char *) &channel_id_be};
 	const int param_lengths[] = {0, sizeof(channel_id_be)};
 	const int param_formats[] = {0, 1};
-	PGresult *res = PQexecParams(conn,
-		"DELETE FROM feeds WHERE url = $1 AND channel_id = $2::bigint",
-		2, NULL, params, param_lengths, param_formats, 1
-	);
+	PGresult *res = exec_stmt(conn, STMT_DELETE, 2, params, param_lengths, param_formats);
 	
 	zblock_feed_info_err result = ZBLOCK_FEED_INFO_OK;
 	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
@@ -192,10 +413,7 @@ zblock_feed_info_err zblock_feed_info_delete_all_guild(PGconn *conn, u64snowflak
 	const char *const params[] = {(char *) &guild_id_be};
 	const int param_lengths[] = {sizeof(guild_id_be)};
 	const int param_formats[] = {1};
-	PGresult *res = PQexecParams(conn,
-		"DELETE FROM feeds WHERE guild_id = $1::bigint",
-		1, NULL, params, param_lengths, param_formats, 1
-	);
+	PGresult *res = exec_stmt(conn, STMT_DELETE_ALL_GUILD, 1, params, param_lengths, param_formats);
 	
 	zblock_feed_info_err result = ZBLOCK_FEED_INFO_OK;
 	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
@@ -215,10 +433,7 @@ zblock_feed_info_err zblock_feed_info_delete_all_channel(PGconn *conn, u64snowfl
 	const char *const params[] = {(char *) &channel_id_be};
 	const int param_lengths[] = {sizeof(channel_id_be)};
 	const int param_formats[] = {1};
-	PGresult *res = PQexecParams(conn,
-		"DELETE FROM feeds WHERE channel_id = $1::bigint",
-		1, NULL, params, param_lengths, param_formats, 1
-	);
+	PGresult *res = exec_stmt(conn, STMT_DELETE_ALL_CHANNEL, 1, params, param_lengths, param_formats);
 
 	zblock_feed_info_err result = ZBLOCK_FEED_INFO_OK;
 	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
@@ -235,13 +450,11 @@ zblock_feed_info_err zblock_feed_info_update(PGconn *conn, zblock_feed_info_mini
 	if (!conn || !feed) return ZBLOCK_FEED_INFO_INVALID_ARGS;
 	
 	uint64_t channel_id_be = htobe64(feed->channel_id);
-	const char *const update_params[] = {feed->last_pubDate, feed->url, (char *) &channel_id_be};
-	const int param_lengths[] = {0, 0, sizeof(channel_id_be)};
-	const int param_formats[] = {0, 0, 1};
-	PGresult *update_res = PQexecParams(conn,
-		"UPDATE feeds SET last_pubDate = $1 WHERE url = $2 AND channel_id = $3::bigint",
-		3, NULL, update_params, param_lengths, param_formats, 1
-	);
+	uint64_t last_pubDate_be = time_t_to_pg_be(feed->last_pubDate);
+	const char *const update_params[] = {(char *) &last_pubDate_be, feed->url, (char *) &channel_id_be};
+	const int param_lengths[] = {sizeof(last_pubDate_be), 0, sizeof(channel_id_be)};
+	const int param_formats[] = {1, 0, 1};
+	PGresult *update_res = exec_stmt(conn, STMT_UPDATE, 3, update_params, param_lengths, param_formats);
 	
 	zblock_feed_info_err result = ZBLOCK_FEED_INFO_OK;
 	if (PQresultStatus(update_res) != PGRES_COMMAND_OK) result = ZBLOCK_FEED_INFO_DBERROR;
@@ -249,6 +462,287 @@ zblock_feed_info_err zblock_feed_info_update(PGconn *conn, zblock_feed_info_mini
 	return result;
 }
 
+// updates the etag and last_modified fields of every subscription to a url in the database
+zblock_feed_info_err zblock_feed_info_update_cache(PGconn *conn, const char *url, const char *etag, const char *last_modified) {
+	if (!conn || !url) return ZBLOCK_FEED_INFO_INVALID_ARGS;
+	
+	// null pointers are sent as NULL
+	const char *const update_params[] = {etag, last_modified, url};
+	PGresult *update_res = exec_stmt(conn, STMT_UPDATE_CACHE, 3, update_params, NULL, NULL);
+	
+	zblock_feed_info_err result = ZBLOCK_FEED_INFO_OK;
+	if (PQresultStatus(update_res) != PGRES_COMMAND_OK) result = ZBLOCK_FEED_INFO_DBERROR;
+	PQclear(update_res);
+	return result;
+}
+
+// sets the poll interval of every subscription to a url and schedules the next poll that many seconds from now
+zblock_feed_info_err zblock_feed_info_update_schedule(PGconn *conn, const char *url, int poll_interval) {
+	if (!conn || !url) return ZBLOCK_FEED_INFO_INVALID_ARGS;
+	
+	uint32_t poll_interval_be = htobe32(poll_interval);
+	const char *const update_params[] = {(char *) &poll_interval_be, url};
+	const int param_lengths[] = {sizeof(poll_interval_be), 0};
+	const int param_formats[] = {1, 0};
+	PGresult *update_res = exec_stmt(conn, STMT_UPDATE_SCHEDULE, 2, update_params, param_lengths, param_formats);
+	
+	zblock_feed_info_err result = ZBLOCK_FEED_INFO_OK;
+	if (PQresultStatus(update_res) != PGRES_COMMAND_OK) result = ZBLOCK_FEED_INFO_DBERROR;
+	PQclear(update_res);
+	return result;
+}
+
+typedef enum {
+	BATCH_UPDATE,
+	BATCH_UPDATE_CACHE,
+	BATCH_UPDATE_SCHEDULE,
+	BATCH_UPDATE_HASH
+} batch_op_type;
+
+// a queued update with its own copies of the parameters
+typedef struct {
+	batch_op_type type;
+	char *str[3];
+	uint64_t channel_id_be;
+	uint64_t last_pubDate_be;
+	uint32_t poll_interval_be;
+	uint64_t content_hash_be;
+} batch_op;
+
+struct zblock_feed_info_batch {
+	PGconn *conn;
+	size_t flush_size;
+	batch_op *ops;
+	size_t nops;
+	size_t ops_capacity;
+};
+
+static void batch_op_free(batch_op *op) {
+	for (size_t i = 0; i < sizeof(op->str) / sizeof(*op->str); ++i) free(op->str[i]);
+}
+
+// fills in the statement and parameters for a queued update, returns the number of parameters
+static int batch_op_params(batch_op *op, feed_info_stmt *stmt, const char *values[3], int lengths[3], int formats[3]) {
+	switch (op->type) {
+		case BATCH_UPDATE:
+			*stmt = STMT_UPDATE;
+			values[0] = (char *) &op->last_pubDate_be; lengths[0] = sizeof(op->last_pubDate_be); formats[0] = 1;
+			values[1] = op->str[0]; lengths[1] = 0; formats[1] = 0;
+			values[2] = (char *) &op->channel_id_be; lengths[2] = sizeof(op->channel_id_be); formats[2] = 1;
+			return 3;
+		case BATCH_UPDATE_CACHE:
+			*stmt = STMT_UPDATE_CACHE;
+			for (int i = 0; i < 3; ++i) {
+				values[i] = op->str[i];
+				lengths[i] = 0;
+				formats[i] = 0;
+			}
+			return 3;
+		case BATCH_UPDATE_HASH:
+			*stmt = STMT_UPDATE_HASH;
+			values[0] = (char *) &op->content_hash_be; lengths[0] = sizeof(op->content_hash_be); formats[0] = 1;
+			values[1] = op->str[0]; lengths[1] = 0; formats[1] = 0;
+			return 2;
+		case BATCH_UPDATE_SCHEDULE:
+		default:
+			*stmt = STMT_UPDATE_SCHEDULE;
+			values[0] = (char *) &op->poll_interval_be; lengths[0] = sizeof(op->poll_interval_be); formats[0] = 1;
+			values[1] = op->str[0]; lengths[1] = 0; formats[1] = 0;
+			return 2;
+	}
+}
+
+// creates a batch of updates for the connection that is flushed automatically every flush_size updates (0 to only flush manually)
+zblock_feed_info_batch *zblock_feed_info_batch_new(PGconn *conn, size_t flush_size) {
+	if (!conn) return NULL;
+	
+	zblock_feed_info_batch *batch = calloc(1, sizeof(*batch));
+	if (!batch) return NULL;
+	batch->conn = conn;
+	batch->flush_size = flush_size;
+	return batch;
+}
+
+// frees a batch without flushing it
+void zblock_feed_info_batch_delete(zblock_feed_info_batch *batch) {
+	if (!batch) return;
+	for (size_t i = 0; i < batch->nops; ++i) batch_op_free(&batch->ops[i]);
+	free(batch->ops);
+	free(batch);
+}
+
+#ifdef LIBPQ_HAS_PIPELINING
+// sends every update at once in pipeline mode. they all run in the same implicit transaction.
+static zblock_feed_info_err batch_send(zblock_feed_info_batch *batch) {
+	PGconn *conn = batch->conn;
+	if (!PQenterPipelineMode(conn)) {
+		log_error("Unable to enter pipeline mode: %s", PQerrorMessage(conn));
+		return ZBLOCK_FEED_INFO_DBERROR;
+	}
+	
+	zblock_feed_info_err result = ZBLOCK_FEED_INFO_OK;
+	size_t nsent = 0;
+	for (; nsent < batch->nops; ++nsent) {
+		feed_info_stmt stmt;
+		const char *values[3];
+		int lengths[3], formats[3];
+		int nparams = batch_op_params(&batch->ops[nsent], &stmt, values, lengths, formats);
+		if (!PQsendQueryPrepared(conn, STATEMENTS[stmt].name, nparams, values, lengths, formats, 1)) {
+			log_error("Unable to send update: %s", PQerrorMessage(conn));
+			result = ZBLOCK_FEED_INFO_DBERROR;
+			break;
+		}
+	}
+	
+	if (!PQpipelineSync(conn)) {
+		log_error("Unable to send updates: %s", PQerrorMessage(conn));
+		PQexitPipelineMode(conn);
+		return ZBLOCK_FEED_INFO_DBERROR;
+	}
+	
+	// every statement has its results followed by a null, then the sync comes last
+	for (size_t i = 0; i < nsent; ++i) {
+		PGresult *res;
+		while ((res = PQgetResult(conn))) {
+			ExecStatusType status = PQresultStatus(res);
+			if (status == PGRES_FATAL_ERROR) {
+				log_error(PQresultErrorMessage(res));
+				result = ZBLOCK_FEED_INFO_DBERROR;
+			} else if (status == PGRES_PIPELINE_ABORTED) {
+				result = ZBLOCK_FEED_INFO_DBERROR;
+			}
+			PQclear(res);
+		}
+	}
+	
+	PGresult *sync_res = PQgetResult(conn);
+	if (PQresultStatus(sync_res) != PGRES_PIPELINE_SYNC) result = ZBLOCK_FEED_INFO_DBERROR;
+	PQclear(sync_res);
+	
+	if (!PQexitPipelineMode(conn)) {
+		log_error("Unable to exit pipeline mode: %s", PQerrorMessage(conn));
+		result = ZBLOCK_FEED_INFO_DBERROR;
+	}
+	return result;
+}
+#else
+// no pipelining in this libpq, so run the updates one by one in a single transaction
+static zblock_feed_info_err batch_send(zblock_feed_info_batch *batch) {
+	PGconn *conn = batch->conn;
+	PGresult *res = PQexec(conn, "BEGIN");
+	bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+	PQclear(res);
+	
+	for (size_t i = 0; ok && i < batch->nops; ++i) {
+		feed_info_stmt stmt;
+		const char *values[3];
+		int lengths[3], formats[3];
+		int nparams = batch_op_params(&batch->ops[i], &stmt, values, lengths, formats);
+		res = PQexecPrepared(conn, STATEMENTS[stmt].name, nparams, values, lengths, formats, 1);
+		if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+			log_error(PQresultErrorMessage(res));
+			ok = false;
+		}
+		PQclear(res);
+	}
+	
+	res = PQexec(conn, ok ? "COMMIT" : "ROLLBACK");
+	if (PQresultStatus(res) != PGRES_COMMAND_OK) ok = false;
+	PQclear(res);
+	return ok ? ZBLOCK_FEED_INFO_OK : ZBLOCK_FEED_INFO_DBERROR;
+}
+#endif
+
+// writes every queued update to the database in one transaction. the batch is emptied even if this fails.
+zblock_feed_info_err zblock_feed_info_batch_flush(zblock_feed_info_batch *batch) {
+	if (!batch) return ZBLOCK_FEED_INFO_INVALID_ARGS;
+	if (!batch->nops) return ZBLOCK_FEED_INFO_OK;
+	
+	uint64_t start = zblock_metrics_now();
+	zblock_feed_info_err result = batch_send(batch);
+	zblock_metrics_observe_since(ZBLOCK_METRIC_DB_BATCH_DURATION, start);
+	for (size_t i = 0; i < batch->nops; ++i) batch_op_free(&batch->ops[i]);
+	batch->nops = 0;
+	return result;
+}
+
+// adds an operation to the batch, flushing it if it's full
+static zblock_feed_info_err batch_push(zblock_feed_info_batch *batch, batch_op *op) {
+	if (batch->nops == batch->ops_capacity) {
+		size_t new_capacity = batch->ops_capacity ? batch->ops_capacity * 2 : 16;
+		batch_op *new_ops = realloc(batch->ops, new_capacity * sizeof(*new_ops));
+		if (!new_ops) {
+			batch_op_free(op);
+			return ZBLOCK_FEED_INFO_NOMEM;
+		}
+		batch->ops = new_ops;
+		batch->ops_capacity = new_capacity;
+	}
+	
+	batch->ops[batch->nops++] = *op;
+	if (batch->flush_size && batch->nops >= batch->flush_size) return zblock_feed_info_batch_flush(batch);
+	return ZBLOCK_FEED_INFO_OK;
+}
+
+static char *strdup_nullable(const char *s) {
+	return s ? strdup(s) : NULL;
+}
+
+// queues an update of the last_pubDate field of a given feed
+zblock_feed_info_err zblock_feed_info_batch_update(zblock_feed_info_batch *batch, const zblock_feed_info_minimal *feed) {
+	if (!batch || !feed) return ZBLOCK_FEED_INFO_INVALID_ARGS;
+	
+	batch_op op = {
+		.type = BATCH_UPDATE,
+		.str = {strdup(feed->url)},
+		.channel_id_be = htobe64(feed->channel_id),
+		.last_pubDate_be = time_t_to_pg_be(feed->last_pubDate)
+	};
+	if (!op.str[0]) return ZBLOCK_FEED_INFO_NOMEM;
+	return batch_push(batch, &op);
+}
+
+// queues an update of the etag and last_modified fields of every subscription to a url
+zblock_feed_info_err zblock_feed_info_batch_update_cache(zblock_feed_info_batch *batch, const char *url, const char *etag, const char *last_modified) {
+	if (!batch || !url) return ZBLOCK_FEED_INFO_INVALID_ARGS;
+	
+	batch_op op = {
+		.type = BATCH_UPDATE_CACHE,
+		.str = {strdup_nullable(etag), strdup_nullable(last_modified), strdup(url)}
+	};
+	if ((etag && !op.str[0]) || (last_modified && !op.str[1]) || !op.str[2]) {
+		batch_op_free(&op);
+		return ZBLOCK_FEED_INFO_NOMEM;
+	}
+	return batch_push(batch, &op);
+}
+
+// queues an update of the poll interval and next poll of every subscription to a url
+zblock_feed_info_err zblock_feed_info_batch_update_schedule(zblock_feed_info_batch *batch, const char *url, int poll_interval) {
+	if (!batch || !url) return ZBLOCK_FEED_INFO_INVALID_ARGS;
+	
+	batch_op op = {
+		.type = BATCH_UPDATE_SCHEDULE,
+		.str = {strdup(url)},
+		.poll_interval_be = htobe32(poll_interval)
+	};
+	if (!op.str[0]) return ZBLOCK_FEED_INFO_NOMEM;
+	return batch_push(batch, &op);
+}
+
+// queues an update of the content hash of every subscription to a url
+zblock_feed_info_err zblock_feed_info_batch_update_hash(zblock_feed_info_batch *batch, const char *url, uint64_t content_hash) {
+	if (!batch || !url) return ZBLOCK_FEED_INFO_INVALID_ARGS;
+	
+	batch_op op = {
+		.type = BATCH_UPDATE_HASH,
+		.str = {strdup(url)},
+		.content_hash_be = htobe64(content_hash)
+	};
+	if (!op.str[0]) return ZBLOCK_FEED_INFO_NOMEM;
+	return batch_push(batch, &op);
+}
+
 // returns the number of feeds in a channel in count
 zblock_feed_info_err zblock_feed_info_count_channel(PGconn *conn, u64snowflake channel_id, int64_t *count) {
 	if (!conn || !count) return ZBLOCK_FEED_INFO_INVALID_ARGS;
@@ -257,10 +751,7 @@ zblock_feed_info_err zblock_feed_info_count_channel(PGconn *conn, u64snowflake c
 	const char *const params[] = {(char *) &channel_id_be};
 	const int param_lengths[] = {sizeof(channel_id_be)};
 	const int param_formats[] = {1};
-	PGresult *res = PQexecParams(conn,
-		"SELECT COUNT(*) FROM feeds WHERE channel_id = $1::bigint",
-		1, NULL, params, param_lengths, param_formats, 1
-	);
+	PGresult *res = exec_stmt(conn, STMT_COUNT_CHANNEL, 1, params, param_lengths, param_formats);
 	
 	if (PQresultStatus(res) != PGRES_TUPLES_OK) {
 		log_error(PQresultErrorMessage(res));
@@ -273,23 +764,21 @@ zblock_feed_info_err zblock_feed_info_count_channel(PGconn *conn, u64snowflake c
 	return ZBLOCK_FEED_INFO_OK;
 }
 
-// returns a chunk of feeds for the given channel in the array provided by chunk.
-// assumes chunk was preallocated with the number of elements in size
+// returns a page of feeds for the given channel in the array provided by page, ordered by id.
+// the page holds the feeds right after the cursor id, or right before it if before is set. a cursor of 0 starts at the first feed.
+// assumes page was preallocated with the number of elements in size
 // num_retrieved is an optional parameter that will contain the number of feeds actually retrieved (in case it is less)
-zblock_feed_info_err zblock_feed_info_retrieve_chunk_channel(PGconn *conn, u64snowflake channel_id, uint64_t offset, size_t size, zblock_feed_info *chunk, int *num_retrieved) {
-	if (!conn || !chunk) return ZBLOCK_FEED_INFO_INVALID_ARGS;
+zblock_feed_info_err zblock_feed_info_retrieve_page_channel(PGconn *conn, u64snowflake channel_id, int64_t cursor, bool before, size_t size, zblock_feed_info *page, int *num_retrieved) {
+	if (!conn || !page) return ZBLOCK_FEED_INFO_INVALID_ARGS;
 	
 	uint64_t channel_id_be = htobe64(channel_id);
-	uint64_t offset_be = htobe64(offset);
+	uint64_t cursor_be = htobe64(cursor);
 	uint64_t size_be = htobe64(size);
 	
-	const char *const params[] = {(char *) &channel_id_be, (char *) &offset_be, (char *) &size_be};
-	const int param_lengths[] = {sizeof(channel_id_be), sizeof(offset_be), sizeof(size_be)};
+	const char *const params[] = {(char *) &channel_id_be, (char *) &cursor_be, (char *) &size_be};
+	const int param_lengths[] = {sizeof(channel_id_be), sizeof(cursor_be), sizeof(size_be)};
 	const int param_formats[] = {1, 1, 1};
-	PGresult *res = PQexecParams(conn,
-		"SELECT url, last_pubDate, channel_id, title, guild_id FROM feeds WHERE channel_id = $1::bigint OFFSET $2::bigint LIMIT $3::bigint",
-		3, NULL, params, param_lengths, param_formats, 1
-	);
+	PGresult *res = exec_stmt(conn, before ? STMT_RETRIEVE_PAGE_BEFORE : STMT_RETRIEVE_PAGE_AFTER, 3, params, param_lengths, param_formats);
 	
 	if (PQresultStatus(res) != PGRES_TUPLES_OK) {
 		log_error(PQresultErrorMessage(res));
@@ -298,19 +787,28 @@ zblock_feed_info_err zblock_feed_info_retrieve_chunk_channel(PGconn *conn, u64sn
 	}
 	
 	int nfeeds = PQntuples(res);
-	if (num_retrieved) *num_retrieved = nfeeds;
 	for (int i = 0; i < nfeeds; ++i) {
-		chunk[i].url = strdup(PQgetvalue(res, i, 0));
-		chunk[i].last_pubDate = strdup(PQgetvalue(res, i, 1));
-		chunk[i].channel_id = be64toh(*(uint64_t *) PQgetvalue(res, i, 2));
-		chunk[i].title = strdup(PQgetvalue(res, i, 3));
-		chunk[i].guild_id = be64toh(*(uint64_t *) PQgetvalue(res, i, 4));
+		// going backwards comes out newest first, so flip it back around
+		int row = before ? nfeeds - 1 - i : i;
+		page[i].id = be64toh(*(uint64_t *) PQgetvalue(res, row, 0));
+		page[i].url = strdup(PQgetvalue(res, row, 1));
+		page[i].last_pubDate = get_last_pubDate(res, row, 2);
+		page[i].channel_id = be64toh(*(uint64_t *) PQgetvalue(res, row, 3));
+		page[i].title = strdup(PQgetvalue(res, row, 4));
+		page[i].guild_id = be64toh(*(uint64_t *) PQgetvalue(res, row, 5));
+		// not needed for listing
+		page[i].etag = NULL;
+		page[i].last_modified = NULL;
+		page[i].poll_interval = 0;
+		page[i].content_hash = 0;
 		
-		if (!chunk[i].url || !chunk[i].last_pubDate || !chunk[i].title) {
+		if (!page[i].url || !page[i].title) {
+			for (int j = 0; j <= i; ++j) zblock_feed_info_free(&page[j]);
 			PQclear(res);
 			return ZBLOCK_FEED_INFO_NOMEM;
 		}
 	}
+	if (num_retrieved) *num_retrieved = nfeeds;
 	
 	PQclear(res);
 	return ZBLOCK_FEED_INFO_OK;
@@ -1,24 +1,37 @@
 #ifndef ZBLOCK_FEED_INFO_H
 #define ZBLOCK_FEED_INFO_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include <concord/discord.h>
 
 #include <libpq-fe.h>
 
 typedef struct {
 	char *url;
-	char *last_pubDate;
+	time_t last_pubDate; // date of the newest item that has been sent (0 if there never was one)
 	u64snowflake channel_id;
+	// cache validators from the last response (NULL if the server didn't send one)
+	char *etag;
+	char *last_modified;
+	int poll_interval; // seconds between polls of this feed
+	uint64_t content_hash; // hash of the start of the last body that was parsed (0 if there isn't one)
 } zblock_feed_info_minimal;
 
 typedef struct {
 	// same definition as feed_info_minimal
 	char *url;
-	char *last_pubDate;
+	time_t last_pubDate;
 	u64snowflake channel_id;
+	char *etag;
+	char *last_modified;
+	int poll_interval;
+	uint64_t content_hash;
 	// extra things
 	char *title;
 	u64snowflake guild_id;
+	int64_t id; // stable key the list is ordered by (only filled in by zblock_feed_info_retrieve_page_channel)
 } zblock_feed_info;
 
 typedef enum {
@@ -38,13 +51,16 @@ void zblock_feed_info_minimal_free(zblock_feed_info_minimal *feed_info);
 // free all information associated with a feed info struct (does not assume the struct was allocated using malloc)
 void zblock_feed_info_free(zblock_feed_info *feed_info);
 
-// maybe change the function signature so you can actually do error handling with the result?
-time_t pubDate_to_time_t(char *s);
-
 // returns a string about the result of a feed_info function
 const char *zblock_feed_info_strerror(zblock_feed_info_err error);
 
-// Begin retrieval of feed info objects.
+// add any columns missing from the feeds table. should be called once at startup.
+zblock_feed_info_err zblock_feed_info_migrate(PGconn *conn);
+
+// prepares every statement on a connection. call this after connecting (and migrating) and after every reset.
+zblock_feed_info_err zblock_feed_info_prepare(PGconn *conn);
+
+// Begin retrieval of feed info objects that are due to be polled. Rows with the same url are returned next to each other.
 zblock_feed_info_err zblock_feed_info_retrieve_list_begin(PGconn *conn);
 
 // Retrieve the next feed list object.
@@ -54,7 +70,7 @@ zblock_feed_info_err zblock_feed_info_retrieve_list_item(PGconn *conn, zblock_fe
 // check if the feed currently exists. the result is in the exists pointer.
 zblock_feed_info_err zblock_feed_info_exists(PGconn *conn, const char *url, u64snowflake channel_id, int *exists);
 
-// Insert new feed into the database. This function assumes that you have already verified that it has not been added previously.
+// Insert new feed into the database. Returns ZBLOCK_FEED_INFO_EXISTS if the channel already has it.
 zblock_feed_info_err zblock_feed_info_insert(PGconn *conn, zblock_feed_info *feed);
 
 // deletes feed from the database
@@ -69,12 +85,45 @@ zblock_feed_info_err zblock_feed_info_delete_all_channel(PGconn *conn, u64snowfl
 // updates the last_pubDate field of a given feed in the database
 zblock_feed_info_err zblock_feed_info_update(PGconn *conn, zblock_feed_info_minimal *feed);
 
+// updates the etag and last_modified fields of every subscription to a url in the database
+zblock_feed_info_err zblock_feed_info_update_cache(PGconn *conn, const char *url, const char *etag, const char *last_modified);
+
+// sets the poll interval of every subscription to a url and schedules the next poll that many seconds from now
+zblock_feed_info_err zblock_feed_info_update_schedule(PGconn *conn, const char *url, int poll_interval);
+
+/* A batch of updates that are sent to the database together.
+ * With a libpq that supports it, the whole batch goes out in one pipeline and is committed as one transaction,
+ * so a poll cycle doesn't pay a round trip for every feed it touches. */
+typedef struct zblock_feed_info_batch zblock_feed_info_batch;
+
+// creates a batch of updates for the connection that is flushed automatically every flush_size updates (0 to only flush manually)
+zblock_feed_info_batch *zblock_feed_info_batch_new(PGconn *conn, size_t flush_size);
+
+// frees a batch without flushing it
+void zblock_feed_info_batch_delete(zblock_feed_info_batch *batch);
+
+// writes every queued update to the database in one transaction. the batch is emptied even if this fails.
+zblock_feed_info_err zblock_feed_info_batch_flush(zblock_feed_info_batch *batch);
+
+// same as zblock_feed_info_update, but queued in a batch
+zblock_feed_info_err zblock_feed_info_batch_update(zblock_feed_info_batch *batch, const zblock_feed_info_minimal *feed);
+
+// same as zblock_feed_info_update_cache, but queued in a batch
+zblock_feed_info_err zblock_feed_info_batch_update_cache(zblock_feed_info_batch *batch, const char *url, const char *etag, const char *last_modified);
+
+// same as zblock_feed_info_update_schedule, but queued in a batch
+zblock_feed_info_err zblock_feed_info_batch_update_schedule(zblock_feed_info_batch *batch, const char *url, int poll_interval);
+
+// queues an update of the content hash of every subscription to a url
+zblock_feed_info_err zblock_feed_info_batch_update_hash(zblock_feed_info_batch *batch, const char *url, uint64_t content_hash);
+
 // returns the number of feeds in a channel in count
 zblock_feed_info_err zblock_feed_info_count_channel(PGconn *conn, u64snowflake channel_id, int64_t *count);
 
-// returns a chunk of feeds for the given channel in the array provided by chunk.
-// assumes chunk was preallocated with the number of elements in size
+// returns a page of feeds for the given channel in the array provided by page, ordered by id.
+// the page holds the feeds right after the cursor id, or right before it if before is set. a cursor of 0 starts at the first feed.
+// assumes page was preallocated with the number of elements in size
 // num_retrieved is an optional parameter that will contain the number of feeds actually retrieved (in case it is less)
-zblock_feed_info_err zblock_feed_info_retrieve_chunk_channel(PGconn *conn, u64snowflake channel_id, uint64_t offset, size_t size, zblock_feed_info *chunk, int *num_retrieved);
+zblock_feed_info_err zblock_feed_info_retrieve_page_channel(PGconn *conn, u64snowflake channel_id, int64_t cursor, bool before, size_t size, zblock_feed_info *page, int *num_retrieved);
 
 #endif
@@ -0,0 +1,546 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "feed_parser.h"
+
+static const char *ZBLOCK_FEED_PARSER_ERRORS[] = {
+	"OK",
+	"Parsing was stopped early",
+	"The document is not an RSS or Atom feed"
+};
+static_assert(sizeof(ZBLOCK_FEED_PARSER_ERRORS) / sizeof(*ZBLOCK_FEED_PARSER_ERRORS) == ZBLOCK_FEED_PARSER_ERRORCOUNT, "Not all feed parser errors implemented");
+
+// tokenizer states
+enum {
+	S_TEXT,
+	S_TAG_OPEN, // after <
+	S_START_NAME,
+	S_END_TAG,
+	S_ATTRS, // between attributes
+	S_ATTR_NAME,
+	S_ATTR_EQ, // after an attribute name, waiting for =
+	S_ATTR_VALUE_START,
+	S_ATTR_VALUE,
+	S_MARKUP, // after <!
+	S_COMMENT_OPEN,
+	S_COMMENT,
+	S_CDATA_OPEN,
+	S_CDATA,
+	S_PI,
+	S_DOCTYPE,
+	S_ENTITY
+};
+
+// kinds of elements we care about
+enum {
+	EL_OTHER,
+	EL_ROOT, // <rss> or <rdf:RDF>
+	EL_CHANNEL, // <channel> or Atom <feed>
+	EL_ITEM // <item> or <entry>
+};
+
+// item dates in order of preference
+enum {
+	DATE_NONE,
+	DATE_UPDATED,
+	DATE_DC,
+	DATE_PUBLISHED,
+	DATE_PUBDATE
+};
+
+static inline bool is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static void field_init(zblock_feed_field *field, char *buf, size_t cap) {
+	*field = (zblock_feed_field) { .buf = buf, .cap = cap };
+	buf[0] = '\0';
+}
+
+static void field_reset(zblock_feed_field *field) {
+	field->len = 0;
+	field->pending_space = false;
+	field->truncated = false;
+	field->buf[0] = '\0';
+}
+
+// appends a character, collapsing runs of whitespace and trimming it from both ends
+static void field_putc(zblock_feed_field *field, char c) {
+	if (is_space(c)) {
+		if (field->len) field->pending_space = true;
+		return;
+	}
+
+	if (field->pending_space) {
+		field->pending_space = false;
+		if (field->len + 1 < field->cap) {
+			field->buf[field->len++] = ' ';
+			field->buf[field->len] = '\0';
+		}
+	}
+
+	if (field->len + 1 < field->cap) {
+		field->buf[field->len++] = c;
+		field->buf[field->len] = '\0';
+	} else {
+		field->truncated = true;
+	}
+}
+
+static void field_copy(zblock_feed_field *dst, const zblock_feed_field *src) {
+	field_reset(dst);
+	for (size_t i = 0; i < src->len; ++i) field_putc(dst, src->buf[i]);
+}
+
+// makes sure truncation didn't leave half of a UTF-8 sequence at the end
+static void field_finish(zblock_feed_field *field) {
+	if (!field->truncated) return;
+
+	size_t start = field->len;
+	while (start > 0 && ((unsigned char) field->buf[start - 1] & 0xC0) == 0x80) --start;
+	if (start == 0) return;
+	unsigned char lead = field->buf[start - 1];
+	size_t seq_len = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+	if (field->len - (start - 1) < seq_len) {
+		field->len = start - 1;
+		field->buf[field->len] = '\0';
+	}
+}
+
+static void field_put_codepoint(zblock_feed_field *field, uint32_t cp) {
+	if (cp < 0x80) {
+		field_putc(field, cp);
+	} else if (cp < 0x800) {
+		field_putc(field, 0xC0 | (cp >> 6));
+		field_putc(field, 0x80 | (cp & 0x3F));
+	} else if (cp < 0x10000) {
+		field_putc(field, 0xE0 | (cp >> 12));
+		field_putc(field, 0x80 | ((cp >> 6) & 0x3F));
+		field_putc(field, 0x80 | (cp & 0x3F));
+	} else if (cp < 0x110000) {
+		field_putc(field, 0xF0 | (cp >> 18));
+		field_putc(field, 0x80 | ((cp >> 12) & 0x3F));
+		field_putc(field, 0x80 | ((cp >> 6) & 0x3F));
+		field_putc(field, 0x80 | (cp & 0x3F));
+	}
+}
+
+static const char *local_name(const char *name) {
+	const char *colon = strchr(name, ':');
+	return colon ? colon + 1 : name;
+}
+
+static bool has_prefix(const char *name) {
+	return strchr(name, ':') != NULL;
+}
+
+// prepares a parser for a new document
+void zblock_feed_parser_init(zblock_feed_parser *parser, zblock_feed_item_callback callback, void *userdata) {
+	memset(parser, 0, offsetof(zblock_feed_parser, tag_href));
+	parser->callback = callback;
+	parser->userdata = userdata;
+	parser->state = S_TEXT;
+
+	field_init(&parser->tag_href, parser->tag_href_buf, sizeof(parser->tag_href_buf));
+	field_init(&parser->tag_rel, parser->tag_rel_buf, sizeof(parser->tag_rel_buf));
+	field_init(&parser->item_title, parser->item_title_buf, sizeof(parser->item_title_buf));
+	field_init(&parser->item_link, parser->item_link_buf, sizeof(parser->item_link_buf));
+	field_init(&parser->item_date, parser->item_date_buf, sizeof(parser->item_date_buf));
+	parser->item_date_priority = DATE_NONE;
+	parser->item_link_alternate = false;
+	field_init(&parser->title_field, parser->title, sizeof(parser->title));
+	field_init(&parser->ttl_field, parser->ttl, sizeof(parser->ttl));
+	field_init(&parser->update_period_field, parser->update_period, sizeof(parser->update_period));
+	field_init(&parser->update_frequency_field, parser->update_frequency, sizeof(parser->update_frequency));
+}
+
+static void begin_capture(zblock_feed_parser *parser, zblock_feed_field *field, int priority) {
+	field_reset(field);
+	parser->capture = field;
+	parser->capture_depth = parser->depth;
+	parser->capture_priority = priority;
+}
+
+// decides what to do with the start tag we just finished reading
+static void start_name_done(zblock_feed_parser *parser) {
+	parser->name[parser->name_len] = '\0';
+	parser->self_closing = false;
+	parser->attr_target = NULL;
+	field_reset(&parser->tag_href);
+	field_reset(&parser->tag_rel);
+
+	// only the links of items have attributes we need
+	int parent = parser->depth > 0 && parser->depth <= ZBLOCK_FEED_PARSER_MAX_DEPTH ? parser->stack[parser->depth - 1] : EL_OTHER;
+	parser->parse_attrs = parent == EL_ITEM && !strcmp(parser->name, "link");
+}
+
+static void attr_name_done(zblock_feed_parser *parser) {
+	parser->attr_name[parser->attr_name_len] = '\0';
+	parser->attr_target = NULL;
+	if (!parser->parse_attrs) return;
+
+	if (!strcmp(parser->attr_name, "href")) parser->attr_target = &parser->tag_href;
+	else if (!strcmp(parser->attr_name, "rel")) parser->attr_target = &parser->tag_rel;
+	if (parser->attr_target) field_reset(parser->attr_target);
+}
+
+static void emit_item(zblock_feed_parser *parser) {
+	field_finish(&parser->item_title);
+	field_finish(&parser->item_link);
+	field_finish(&parser->item_date);
+
+	zblock_feed_entry entry = {
+		.title = parser->item_title.buf,
+		.link = parser->item_link.buf,
+		.pubDate = parser->item_date.buf
+	};
+	if (parser->callback && !parser->callback(parser->userdata, &entry)) parser->stopped = true;
+
+	field_reset(&parser->item_title);
+	field_reset(&parser->item_link);
+	field_reset(&parser->item_date);
+	parser->item_date_priority = DATE_NONE;
+	parser->item_link_alternate = false;
+}
+
+static void element_close(zblock_feed_parser *parser) {
+	if (parser->depth == 0) return; // stray end tag
+
+	if (parser->capture && parser->capture_depth == parser->depth) {
+		field_finish(parser->capture);
+		if (parser->capture == &parser->item_date) parser->item_date_priority = parser->capture_priority;
+		parser->capture = NULL;
+	}
+
+	int kind = parser->depth <= ZBLOCK_FEED_PARSER_MAX_DEPTH ? parser->stack[parser->depth - 1] : EL_OTHER;
+	--parser->depth;
+	if (kind == EL_ITEM) emit_item(parser);
+}
+
+static void element_open(zblock_feed_parser *parser) {
+	const char *name = parser->name;
+	int parent = parser->depth > 0 && parser->depth <= ZBLOCK_FEED_PARSER_MAX_DEPTH ? parser->stack[parser->depth - 1] : EL_OTHER;
+	bool nested = parser->depth > ZBLOCK_FEED_PARSER_MAX_DEPTH;
+
+	int kind = EL_OTHER;
+	if (parser->depth == 0) {
+		if (!strcmp(name, "rss") || !strcmp(local_name(name), "RDF")) {
+			kind = EL_ROOT;
+			parser->seen_root = true;
+		} else if (!strcmp(name, "feed")) {
+			kind = EL_CHANNEL;
+			parser->seen_root = true;
+		}
+	} else if (!nested) {
+		if (parent == EL_ROOT && !strcmp(name, "channel")) kind = EL_CHANNEL;
+		else if ((parent == EL_ROOT || parent == EL_CHANNEL) && !strcmp(name, "item")) kind = EL_ITEM;
+		else if (parent == EL_CHANNEL && !strcmp(name, "entry")) kind = EL_ITEM;
+	}
+
+	if (parser->depth < ZBLOCK_FEED_PARSER_MAX_DEPTH) parser->stack[parser->depth] = kind;
+	++parser->depth;
+
+	// start collecting the text of anything we need (nested elements are included in the text)
+	if (!parser->capture && !nested) {
+		if (parent == EL_CHANNEL) {
+			if (!strcmp(name, "title")) {
+				if (!parser->title_field.len) begin_capture(parser, &parser->title_field, 0);
+			} else if (!strcmp(name, "ttl")) {
+				begin_capture(parser, &parser->ttl_field, 0);
+			} else if (has_prefix(name) && !strcmp(local_name(name), "updatePeriod")) {
+				begin_capture(parser, &parser->update_period_field, 0);
+			} else if (has_prefix(name) && !strcmp(local_name(name), "updateFrequency")) {
+				begin_capture(parser, &parser->update_frequency_field, 0);
+			}
+		} else if (parent == EL_ITEM) {
+			int date_priority = DATE_NONE;
+			if (!strcmp(name, "title")) {
+				begin_capture(parser, &parser->item_title, 0);
+			} else if (!strcmp(name, "link")) {
+				if (parser->tag_href.len) {
+					// Atom links are in the href, the alternate link is the one we want
+					bool alternate = !parser->tag_rel.len || !strcmp(parser->tag_rel.buf, "alternate");
+					if ((alternate && !parser->item_link_alternate) || !parser->item_link.len) {
+						field_copy(&parser->item_link, &parser->tag_href);
+						parser->item_link_alternate = alternate;
+					}
+				} else if (!parser->item_link.len) {
+					begin_capture(parser, &parser->item_link, 0);
+				}
+			} else if (!strcmp(name, "pubDate")) {
+				date_priority = DATE_PUBDATE;
+			} else if (!strcmp(name, "published")) {
+				date_priority = DATE_PUBLISHED;
+			} else if (has_prefix(name) && !strcmp(local_name(name), "date")) {
+				date_priority = DATE_DC;
+			} else if (!strcmp(name, "updated")) {
+				date_priority = DATE_UPDATED;
+			}
+
+			if (date_priority > parser->item_date_priority) begin_capture(parser, &parser->item_date, date_priority);
+		}
+	}
+
+	if (parser->self_closing) element_close(parser);
+}
+
+// handles the end of an entity reference
+static void entity_done(zblock_feed_parser *parser) {
+	zblock_feed_field *target = parser->entity_target;
+	parser->entity[parser->entity_len] = '\0';
+	if (!target) return;
+
+	const char *e = parser->entity;
+	if (!strcmp(e, "lt")) field_putc(target, '<');
+	else if (!strcmp(e, "gt")) field_putc(target, '>');
+	else if (!strcmp(e, "amp")) field_putc(target, '&');
+	else if (!strcmp(e, "quot")) field_putc(target, '"');
+	else if (!strcmp(e, "apos")) field_putc(target, '\'');
+	else if (e[0] == '#' && e[1]) {
+		char *end;
+		unsigned long cp = e[1] == 'x' || e[1] == 'X' ? strtoul(e + 2, &end, 16) : strtoul(e + 1, &end, 10);
+		if (!*end && cp) field_put_codepoint(target, cp);
+	} else {
+		// not something XML knows about (probably HTML), leave it as it was
+		field_putc(target, '&');
+		for (const char *c = e; *c; ++c) field_putc(target, *c);
+		field_putc(target, ';');
+	}
+}
+
+/* Parses the next chunk of a document.
+ * Returns ZBLOCK_FEED_PARSER_STOPPED once the item callback has asked to stop, after which no more data is read. */
+zblock_feed_parser_err zblock_feed_parser_parse(zblock_feed_parser *parser, const char *data, size_t size) {
+	// i is unsigned, so stepping back from the first character wraps around and the loop brings it back to 0
+	for (size_t i = 0; i < size && !parser->stopped; ++i) {
+		char c = data[i];
+		switch (parser->state) {
+			case S_TEXT:
+				if (!parser->capture) {
+					// nothing to keep, skip straight to the next tag
+					const char *tag = memchr(data + i, '<', size - i);
+					if (!tag) return ZBLOCK_FEED_PARSER_OK;
+					i = tag - data;
+					parser->state = S_TAG_OPEN;
+				} else if (c == '<') {
+					parser->state = S_TAG_OPEN;
+				} else if (c == '&') {
+					parser->entity_len = 0;
+					parser->entity_target = parser->capture;
+					parser->return_state = S_TEXT;
+					parser->state = S_ENTITY;
+				} else {
+					field_putc(parser->capture, c);
+				}
+				break;
+			case S_TAG_OPEN:
+				if (c == '/') {
+					parser->state = S_END_TAG;
+				} else if (c == '!') {
+					parser->state = S_MARKUP;
+				} else if (c == '?') {
+					parser->match = 0;
+					parser->state = S_PI;
+				} else {
+					parser->name_len = 0;
+					parser->name[parser->name_len++] = c;
+					parser->state = S_START_NAME;
+				}
+				break;
+			case S_START_NAME:
+				if (is_space(c)) {
+					start_name_done(parser);
+					parser->state = S_ATTRS;
+				} else if (c == '/') {
+					start_name_done(parser);
+					parser->self_closing = true;
+					parser->state = S_ATTRS;
+				} else if (c == '>') {
+					start_name_done(parser);
+					parser->state = S_TEXT;
+					element_open(parser);
+				} else if (parser->name_len + 1 < sizeof(parser->name)) {
+					parser->name[parser->name_len++] = c;
+				}
+				break;
+			case S_END_TAG:
+				if (c == '>') {
+					parser->state = S_TEXT;
+					element_close(parser);
+				}
+				break;
+			case S_ATTRS:
+				if (c == '/') {
+					parser->self_closing = true;
+				} else if (c == '>') {
+					parser->state = S_TEXT;
+					element_open(parser);
+				} else if (!is_space(c)) {
+					parser->self_closing = false;
+					parser->attr_name_len = 0;
+					parser->attr_name[parser->attr_name_len++] = c;
+					parser->state = S_ATTR_NAME;
+				}
+				break;
+			case S_ATTR_NAME:
+				if (c == '=') {
+					attr_name_done(parser);
+					parser->state = S_ATTR_VALUE_START;
+				} else if (is_space(c)) {
+					attr_name_done(parser);
+					parser->state = S_ATTR_EQ;
+				} else if (c == '/') {
+					parser->self_closing = true;
+					parser->state = S_ATTRS;
+				} else if (c == '>') {
+					parser->state = S_TEXT;
+					element_open(parser);
+				} else if (parser->attr_name_len + 1 < sizeof(parser->attr_name)) {
+					parser->attr_name[parser->attr_name_len++] = c;
+				}
+				break;
+			case S_ATTR_EQ:
+				if (c == '=') {
+					parser->state = S_ATTR_VALUE_START;
+				} else if (c == '>') {
+					parser->state = S_TEXT;
+					element_open(parser);
+				} else if (!is_space(c)) {
+					// the last attribute had no value, this is the next one
+					--i;
+					parser->state = S_ATTRS;
+				}
+				break;
+			case S_ATTR_VALUE_START:
+				if (c == '"' || c == '\'') {
+					parser->quote = c;
+					parser->state = S_ATTR_VALUE;
+				} else if (c == '>') {
+					parser->state = S_TEXT;
+					element_open(parser);
+				} else if (!is_space(c)) {
+					parser->quote = '\0';
+					--i;
+					parser->state = S_ATTR_VALUE;
+				}
+				break;
+			case S_ATTR_VALUE:
+				if (parser->quote ? c == parser->quote : is_space(c)) {
+					parser->state = S_ATTRS;
+				} else if (!parser->quote && c == '>') {
+					parser->state = S_TEXT;
+					element_open(parser);
+				} else if (c == '&') {
+					parser->entity_len = 0;
+					parser->entity_target = parser->attr_target;
+					parser->return_state = S_ATTR_VALUE;
+					parser->state = S_ENTITY;
+				} else if (parser->attr_target) {
+					field_putc(parser->attr_target, c);
+				}
+				break;
+			case S_MARKUP:
+				if (c == '-') {
+					parser->state = S_COMMENT_OPEN;
+				} else if (c == '[') {
+					parser->match = 1;
+					parser->state = S_CDATA_OPEN;
+				} else {
+					parser->match = 0;
+					--i;
+					parser->state = S_DOCTYPE;
+				}
+				break;
+			case S_COMMENT_OPEN:
+				parser->match = 0;
+				if (c == '-') {
+					parser->state = S_COMMENT;
+				} else {
+					--i;
+					parser->state = S_DOCTYPE;
+				}
+				break;
+			case S_COMMENT:
+				if (c == '-') {
+					if (parser->match < 2) ++parser->match;
+				} else {
+					if (c == '>' && parser->match == 2) parser->state = S_TEXT;
+					parser->match = 0;
+				}
+				break;
+			case S_CDATA_OPEN: {
+				static const char CDATA_OPEN[] = "[CDATA[";
+				if (c == CDATA_OPEN[parser->match]) {
+					if (++parser->match == sizeof(CDATA_OPEN) - 1) {
+						parser->match = 0;
+						parser->state = S_CDATA;
+					}
+				} else {
+					parser->match = 0;
+					--i;
+					parser->state = S_DOCTYPE;
+				}
+			} break;
+			case S_CDATA:
+				if (c == ']') {
+					if (parser->match < 2) ++parser->match;
+					else if (parser->capture) field_putc(parser->capture, ']');
+				} else if (c == '>' && parser->match == 2) {
+					parser->match = 0;
+					parser->state = S_TEXT;
+				} else {
+					if (parser->capture) {
+						for (; parser->match > 0; --parser->match) field_putc(parser->capture, ']');
+						field_putc(parser->capture, c);
+					}
+					parser->match = 0;
+				}
+				break;
+			case S_PI:
+				if (c == '>' && parser->match) parser->state = S_TEXT;
+				parser->match = c == '?';
+				break;
+			case S_DOCTYPE:
+				// skips over any internal subset too
+				if (c == '[') ++parser->match;
+				else if (c == ']') --parser->match;
+				else if (c == '>' && parser->match <= 0) parser->state = S_TEXT;
+				break;
+			case S_ENTITY:
+				if (c == ';') {
+					entity_done(parser);
+					parser->state = parser->return_state;
+				} else if ((c == '#' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+					&& parser->entity_len + 1 < sizeof(parser->entity)) {
+					parser->entity[parser->entity_len++] = c;
+				} else {
+					// a bare ampersand, keep it and look at this character again
+					if (parser->entity_target) {
+						field_putc(parser->entity_target, '&');
+						for (size_t i = 0; i < parser->entity_len; ++i) field_putc(parser->entity_target, parser->entity[i]);
+					}
+					--i;
+					parser->state = parser->return_state;
+				}
+				break;
+		}
+	}
+
+	return parser->stopped ? ZBLOCK_FEED_PARSER_STOPPED : ZBLOCK_FEED_PARSER_OK;
+}
+
+// call after the whole document has been parsed. checks that it was actually a feed.
+zblock_feed_parser_err zblock_feed_parser_finish(zblock_feed_parser *parser) {
+	field_finish(&parser->title_field);
+	if (parser->stopped) return ZBLOCK_FEED_PARSER_STOPPED;
+	return parser->seen_root ? ZBLOCK_FEED_PARSER_OK : ZBLOCK_FEED_PARSER_NOT_A_FEED;
+}
+
+// returns a string about the result of a feed parser function
+const char *zblock_feed_parser_strerror(zblock_feed_parser_err error) {
+	return error < 0 || error >= ZBLOCK_FEED_PARSER_ERRORCOUNT ? "Unspecified error" : ZBLOCK_FEED_PARSER_ERRORS[error];
+}
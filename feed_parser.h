@@ -0,0 +1,110 @@
+#ifndef ZBLOCK_FEED_PARSER_H
+#define ZBLOCK_FEED_PARSER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// maximum lengths of the fields kept by the parser (longer values are truncated)
+#define ZBLOCK_FEED_PARSER_TITLE_LEN 512
+#define ZBLOCK_FEED_PARSER_LINK_LEN 2048
+#define ZBLOCK_FEED_PARSER_DATE_LEN 64
+#define ZBLOCK_FEED_PARSER_SHORT_LEN 32
+#define ZBLOCK_FEED_PARSER_NAME_LEN 64
+#define ZBLOCK_FEED_PARSER_MAX_DEPTH 32
+
+// an item (RSS) or entry (Atom) in a feed. the strings are only valid during the item callback.
+typedef struct {
+	const char *title;
+	const char *link;
+	const char *pubDate; // pubDate, published, dc:date or updated, whichever is found first in that order
+} zblock_feed_entry;
+
+/* Called for every item in the feed as soon as it has been parsed.
+ * Return false to stop parsing the rest of the feed. */
+typedef bool (*zblock_feed_item_callback)(void *userdata, const zblock_feed_entry *entry);
+
+typedef enum {
+	ZBLOCK_FEED_PARSER_OK,
+	ZBLOCK_FEED_PARSER_STOPPED,
+	ZBLOCK_FEED_PARSER_NOT_A_FEED,
+	ZBLOCK_FEED_PARSER_ERRORCOUNT
+} zblock_feed_parser_err;
+
+// a field being collected out of the text of an element
+typedef struct {
+	char *buf;
+	size_t cap;
+	size_t len;
+	bool pending_space;
+	bool truncated;
+} zblock_feed_field;
+
+/* Streaming RSS/Atom parser that only keeps what zblock needs.
+ * Data can be handed to it in chunks of any size as it arrives, and no memory is allocated.
+ * Treat the contents as private, only the feed-level fields at the bottom are meant to be read. */
+typedef struct {
+	zblock_feed_item_callback callback;
+	void *userdata;
+
+	int state;
+	int return_state; // state to go back to after an entity
+	char quote; // quote character of the current attribute value
+	int match; // progress through the end of a comment, CDATA section or markup declaration
+	bool self_closing;
+	bool stopped;
+	bool seen_root;
+
+	char name[ZBLOCK_FEED_PARSER_NAME_LEN];
+	size_t name_len;
+	char attr_name[ZBLOCK_FEED_PARSER_SHORT_LEN];
+	size_t attr_name_len;
+	char entity[12];
+	size_t entity_len;
+
+	// elements we're inside of
+	unsigned char stack[ZBLOCK_FEED_PARSER_MAX_DEPTH];
+	int depth;
+
+	// what is being collected right now and the depth of the element it came from
+	zblock_feed_field *capture;
+	int capture_depth;
+	int capture_priority;
+
+	// attributes of the current tag
+	bool parse_attrs;
+	zblock_feed_field *attr_target;
+	zblock_feed_field *entity_target;
+	zblock_feed_field tag_href, tag_rel;
+	char tag_href_buf[ZBLOCK_FEED_PARSER_LINK_LEN];
+	char tag_rel_buf[ZBLOCK_FEED_PARSER_SHORT_LEN];
+
+	// the item currently being parsed
+	zblock_feed_field item_title, item_link, item_date;
+	char item_title_buf[ZBLOCK_FEED_PARSER_TITLE_LEN];
+	char item_link_buf[ZBLOCK_FEED_PARSER_LINK_LEN];
+	char item_date_buf[ZBLOCK_FEED_PARSER_DATE_LEN];
+	int item_date_priority;
+	bool item_link_alternate;
+
+	// feed-level fields, NUL-terminated (empty if the feed doesn't have them)
+	zblock_feed_field title_field, ttl_field, update_period_field, update_frequency_field;
+	char title[ZBLOCK_FEED_PARSER_TITLE_LEN];
+	char ttl[ZBLOCK_FEED_PARSER_SHORT_LEN];
+	char update_period[ZBLOCK_FEED_PARSER_SHORT_LEN];
+	char update_frequency[ZBLOCK_FEED_PARSER_SHORT_LEN];
+} zblock_feed_parser;
+
+// prepares a parser for a new document
+void zblock_feed_parser_init(zblock_feed_parser *parser, zblock_feed_item_callback callback, void *userdata);
+
+/* Parses the next chunk of a document.
+ * Returns ZBLOCK_FEED_PARSER_STOPPED once the item callback has asked to stop, after which no more data is read. */
+zblock_feed_parser_err zblock_feed_parser_parse(zblock_feed_parser *parser, const char *data, size_t size);
+
+// call after the whole document has been parsed. checks that it was actually a feed.
+zblock_feed_parser_err zblock_feed_parser_finish(zblock_feed_parser *parser);
+
+// returns a string about the result of a feed parser function
+const char *zblock_feed_parser_strerror(zblock_feed_parser_err error);
+
+#endif
@@ -0,0 +1,250 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <concord/discord.h>
+
+#include "arena.h"
+#include "feed_info.h"
+#include "list_cache.h"
+
+#define LIST_CACHE_BUCKETS 256
+
+struct cached_page {
+	u64snowflake channel_id;
+	int64_t cursor;
+	bool before;
+	time_t expires;
+	int num;
+	zblock_feed_info *feeds; // only url, last_pubDate, title, guild_id and id are kept
+	struct cached_page *bucket_next; // next page in the same hash bucket
+	struct cached_page *newer, *older; // recently used order
+};
+
+static struct {
+	struct cached_page *buckets[LIST_CACHE_BUCKETS];
+	struct cached_page *newest, *oldest;
+	int npages;
+	uint64_t generation; // bumped by every invalidation
+	pthread_mutex_t lock;
+} cache = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static unsigned bucket_index(u64snowflake channel_id, int64_t cursor, bool before) {
+	uint64_t hash = channel_id ^ ((uint64_t) cursor * 0x9e3779b97f4a7c15) ^ before;
+	hash ^= hash >> 29;
+	return hash % LIST_CACHE_BUCKETS;
+}
+
+static void page_free(struct cached_page *page) {
+	for (int i = 0; i < page->num; ++i) zblock_feed_info_free(&page->feeds[i]);
+	free(page->feeds);
+	free(page);
+}
+
+// takes a page out of the recently used list. the lock must be held.
+static void page_remove_recent(struct cached_page *page) {
+	if (page->newer) page->newer->older = page->older;
+	else cache.newest = page->older;
+	if (page->older) page->older->newer = page->newer;
+	else cache.oldest = page->newer;
+}
+
+// puts a page at the front of the recently used list. the lock must be held.
+static void page_push_newest(struct cached_page *page) {
+	page->newer = NULL;
+	page->older = cache.newest;
+	if (cache.newest) cache.newest->newer = page;
+	else cache.oldest = page;
+	cache.newest = page;
+}
+
+// takes a page out of its bucket and the recently used list. the lock must be held.
+static void page_unlink(struct cached_page *page) {
+	struct cached_page **link = &cache.buckets[bucket_index(page->channel_id, page->cursor, page->before)];
+	while (*link != page) link = &(*link)->bucket_next;
+	*link = page->bucket_next;
+	page_remove_recent(page);
+	--cache.npages;
+}
+
+// the lock must be held
+static struct cached_page *page_find(u64snowflake channel_id, int64_t cursor, bool before) {
+	struct cached_page *page = cache.buckets[bucket_index(channel_id, cursor, before)];
+	while (page && !(page->channel_id == channel_id && page->cursor == cursor && page->before == before)) page = page->bucket_next;
+	return page;
+}
+
+// copies the parts of a feed that the list shows
+static bool feed_copy(zblock_feed_info *dest, const zblock_feed_info *src) {
+	*dest = (zblock_feed_info) {
+		.url = strdup(src->url),
+		.last_pubDate = src->last_pubDate,
+		.channel_id = src->channel_id,
+		.title = strdup(src->title),
+		.guild_id = src->guild_id,
+		.id = src->id
+	};
+	if (dest->url && dest->title) return true;
+	zblock_feed_info_free(dest);
+	return false;
+}
+
+// same as feed_copy, but into an arena so serving a page from the cache doesn't touch the heap
+static bool feed_copy_arena(Arena *arena, zblock_feed_info *dest, const zblock_feed_info *src) {
+	*dest = (zblock_feed_info) {
+		.url = Arena_copy(arena, src->url, strlen(src->url) + 1),
+		.last_pubDate = src->last_pubDate,
+		.channel_id = src->channel_id,
+		.title = Arena_copy(arena, src->title, strlen(src->title) + 1),
+		.guild_id = src->guild_id,
+		.id = src->id
+	};
+	return dest->url && dest->title;
+}
+
+// returns the current generation of the cache. take this before reading a page from the database and hand it to zblock_list_cache_put.
+uint64_t zblock_list_cache_generation(void) {
+	pthread_mutex_lock(&cache.lock);
+	uint64_t generation = cache.generation;
+	pthread_mutex_unlock(&cache.lock);
+	return generation;
+}
+
+/* Copies a cached page into the array provided by page, which has room for size feeds.
+ * The pages are keyed the same way as zblock_feed_info_retrieve_page_channel. The strings are copied into arena,
+ * so the copies are gone along with it and nothing has to be freed.
+ * Returns false if the page isn't cached (or couldn't be copied). */
+bool zblock_list_cache_get(Arena *arena, u64snowflake channel_id, int64_t cursor, bool before, zblock_feed_info *page, int size, int *num_retrieved) {
+	pthread_mutex_lock(&cache.lock);
+	struct cached_page *cached = page_find(channel_id, cursor, before);
+	if (cached && (cached->expires <= time(NULL) || cached->num > size)) {
+		page_unlink(cached);
+		page_free(cached);
+		cached = NULL;
+	}
+	if (!cached) {
+		pthread_mutex_unlock(&cache.lock);
+		return false;
+	}
+
+	for (int i = 0; i < cached->num; ++i) {
+		if (!feed_copy_arena(arena, &page[i], &cached->feeds[i])) {
+			pthread_mutex_unlock(&cache.lock);
+			return false;
+		}
+	}
+	if (num_retrieved) *num_retrieved = cached->num;
+
+	// keep it around longer than the pages nobody is looking at
+	page_remove_recent(cached);
+	page_push_newest(cached);
+	pthread_mutex_unlock(&cache.lock);
+
+	return true;
+}
+
+/* Caches a page that was read from the database.
+ * Nothing is cached if the cache was invalidated since generation was taken, since the page might be from before the change. */
+void zblock_list_cache_put(uint64_t generation, u64snowflake channel_id, int64_t cursor, bool before, const zblock_feed_info *page, int num) {
+	// copy everything before taking the lock
+	struct cached_page *cached = malloc(sizeof(*cached));
+	if (!cached) return;
+	*cached = (struct cached_page) {
+		.channel_id = channel_id,
+		.cursor = cursor,
+		.before = before,
+		.expires = time(NULL) + ZBLOCK_LIST_CACHE_TTL,
+		.feeds = num ? malloc(num * sizeof(*cached->feeds)) : NULL
+	};
+	if (num && !cached->feeds) {
+		free(cached);
+		return;
+	}
+	for (; cached->num < num; ++cached->num) {
+		if (!feed_copy(&cached->feeds[cached->num], &page[cached->num])) {
+			page_free(cached);
+			return;
+		}
+	}
+
+	pthread_mutex_lock(&cache.lock);
+	if (generation != cache.generation) {
+		pthread_mutex_unlock(&cache.lock);
+		page_free(cached);
+		return;
+	}
+
+	// two workers can read the same page at once, the newer copy wins
+	struct cached_page *old = page_find(channel_id, cursor, before);
+	if (old) {
+		page_unlink(old);
+		page_free(old);
+	}
+	while (cache.npages >= ZBLOCK_LIST_CACHE_MAX_PAGES) {
+		struct cached_page *oldest = cache.oldest;
+		page_unlink(oldest);
+		page_free(oldest);
+	}
+
+	struct cached_page **bucket = &cache.buckets[bucket_index(channel_id, cursor, before)];
+	cached->bucket_next = *bucket;
+	*bucket = cached;
+	page_push_newest(cached);
+	++cache.npages;
+	pthread_mutex_unlock(&cache.lock);
+}
+
+// drops every page that matches. the lock must be held.
+static void invalidate_where(bool (*match)(const struct cached_page *page, u64snowflake id), u64snowflake id) {
+	++cache.generation;
+	struct cached_page *page = cache.newest;
+	while (page) {
+		struct cached_page *older = page->older;
+		if (match(page, id)) {
+			page_unlink(page);
+			page_free(page);
+		}
+		page = older;
+	}
+}
+
+static bool match_channel(const struct cached_page *page, u64snowflake channel_id) {
+	return page->channel_id == channel_id;
+}
+
+static bool match_guild(const struct cached_page *page, u64snowflake guild_id) {
+	// every feed on a page is from the same channel, so the first one says which guild it's in
+	return page->num && page->feeds[0].guild_id == guild_id;
+}
+
+static bool match_all(const struct cached_page *page, u64snowflake id) {
+	(void) page;
+	(void) id;
+	return true;
+}
+
+// drops every cached page of a channel. call this after the channel's feeds change.
+void zblock_list_cache_invalidate_channel(u64snowflake channel_id) {
+	pthread_mutex_lock(&cache.lock);
+	invalidate_where(&match_channel, channel_id);
+	pthread_mutex_unlock(&cache.lock);
+}
+
+// drops every cached page with feeds from a guild
+void zblock_list_cache_invalidate_guild(u64snowflake guild_id) {
+	pthread_mutex_lock(&cache.lock);
+	invalidate_where(&match_guild, guild_id);
+	pthread_mutex_unlock(&cache.lock);
+}
+
+// drops everything in the cache
+void zblock_list_cache_clear(void) {
+	pthread_mutex_lock(&cache.lock);
+	invalidate_where(&match_all, 0);
+	pthread_mutex_unlock(&cache.lock);
+}
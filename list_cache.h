@@ -0,0 +1,40 @@
+#ifndef ZBLOCK_LIST_CACHE_H
+#define ZBLOCK_LIST_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <concord/discord.h>
+
+#include "arena.h"
+#include "feed_info.h"
+
+// how long a cached page is used before going back to the database (in seconds). this is how stale "Last updated" can get.
+#define ZBLOCK_LIST_CACHE_TTL 60
+
+// most pages kept at once across every channel. the least recently used one is dropped to make room.
+#define ZBLOCK_LIST_CACHE_MAX_PAGES 1024
+
+// returns the current generation of the cache. take this before reading a page from the database and hand it to zblock_list_cache_put.
+uint64_t zblock_list_cache_generation(void);
+
+/* Copies a cached page into the array provided by page, which has room for size feeds.
+ * The pages are keyed the same way as zblock_feed_info_retrieve_page_channel. The strings are copied into arena,
+ * so the copies are gone along with it and nothing has to be freed.
+ * Returns false if the page isn't cached (or couldn't be copied). */
+bool zblock_list_cache_get(Arena *arena, u64snowflake channel_id, int64_t cursor, bool before, zblock_feed_info *page, int size, int *num_retrieved);
+
+/* Caches a page that was read from the database.
+ * Nothing is cached if the cache was invalidated since generation was taken, since the page might be from before the change. */
+void zblock_list_cache_put(uint64_t generation, u64snowflake channel_id, int64_t cursor, bool before, const zblock_feed_info *page, int num);
+
+// drops every cached page of a channel. call this after the channel's feeds change.
+void zblock_list_cache_invalidate_channel(u64snowflake channel_id);
+
+// drops every cached page with feeds from a guild
+void zblock_list_cache_invalidate_guild(u64snowflake guild_id);
+
+// drops everything in the cache
+void zblock_list_cache_clear(void);
+
+#endif
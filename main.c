@@ -3,25 +3,29 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
-#include <locale.h>
 #include <time.h>
-#include <pthread.h>
-
-#include <curl/curl.h>
 
 #include <concord/discord.h>
 #include <concord/log.h>
 
-#include <mrss.h>
-
 #include <libpq-fe.h>
 
 #include "config.h"
 #include "feed_info.h"
+#include "date.h"
+#include "poller.h"
+#include "outbox.h"
+#include "db_pool.h"
+#include "db_worker.h"
+#include "list_cache.h"
+#include "arena_pool.h"
+#include "feed_fetch.h"
 #include "arena.h"
+#include "metrics.h"
 
 // Function pointer type for commands
 typedef void (*command_func)(struct discord *, const struct discord_interaction *);
@@ -43,6 +47,10 @@ struct bot_command {
 #define _CREATE_COMPONENTS(components) &(struct discord_components) { .size = sizeof((struct discord_component[]) components) / sizeof(struct discord_component), .array = (struct discord_component[]) components }
 #define CREATE_COMPONENTS(...) _CREATE_COMPONENTS(P99_PROTECT(__VA_ARGS__))
 
+// interactions skip ahead of anything else concord has queued, discord only waits 3 seconds for a response
+#define RESPONSE_HIGH_PRIORITY &(struct discord_ret_interaction_response) { .high_priority = true }
+#define EDIT_HIGH_PRIORITY &(struct discord_ret_message) { .high_priority = true }
+
 #define BOT_COMMAND_NOT_IMPLEMENTED() do { \
 	struct discord_interaction_response res = { \
 		.type = DISCORD_INTERACTION_CHANNEL_MESSAGE_WITH_SOURCE, \
@@ -50,172 +58,24 @@ struct bot_command {
 			.content = "This command has not been implemented yet." \
 		} \
 	}; \
-	discord_create_interaction_response(client, event->id, event->token, &res, NULL); \
+	discord_create_interaction_response(client, event->id, event->token, &res, RESPONSE_HIGH_PRIORITY); \
 } while (0)
 
-typedef struct {
-	zblock_feed_info_minimal info;
-	FILE *fp;
-	char *buf;
-	size_t bufsize;
-} zblock_feed_buffer;
-
-// the database connection
-static PGconn *database_conn;
-
-// this does not account for large-scale usage yet.
-static void *thread_retrieve_feeds(void *arg) {
-	struct discord *client = arg;
-
-	// all of this is as asynchronous as I can reasonably make it
-	CURLM *multi = curl_multi_init();
-	if (!multi) {
-		// oh no
-		log_error("Unable to retrieve feed list: NULL pointer from curl_multi_init()");
-		return NULL;
-	}
-	
-	PGconn *database_conn = PQconnectdb(zblock_config.conninfo); // yes i know this name is reused
-	if (!database_conn) {
-		log_error("Failed to connect to database.");
-		curl_multi_cleanup(multi);
-		return NULL;
-	}
-	
-	// Begin retrieval of feed list objects.
-	if (zblock_feed_info_retrieve_list_begin(database_conn)) {
-		log_error("Unable to retrieve feed list: %s", PQerrorMessage(database_conn));
-		curl_multi_cleanup(multi);
-		return NULL;
-	}
-	
-	// put running handles up here so we can start transfers now instead of later
-	int running_handles, total_feeds = 0;
-	// get all the required feed info to send messages
-	zblock_feed_info_minimal feed_info;
-	while (!zblock_feed_info_retrieve_list_item(database_conn, &feed_info)) {
-		++total_feeds;
-		zblock_feed_buffer *feed_buffer = malloc(sizeof(*feed_buffer));
-		if (!feed_buffer) {
-			log_error("Failure allocating feed buffer: %s", strerror(errno));
-			continue;
-		}
-		feed_buffer->info = feed_info;
-		feed_buffer->fp = open_memstream(&feed_buffer->buf, &feed_buffer->bufsize);
-		if (!feed_buffer->fp) {
-			log_error("Unable to retrieve feed: %s", strerror(errno));
-			zblock_feed_info_minimal_free(&feed_buffer->info);
-			free(feed_buffer);
-			continue;
-		}
-	
-		CURL *feed_handle = curl_easy_init();
-		if (!feed_handle) {
-			fclose(feed_buffer->fp);
-			free(feed_buffer->buf);
-			zblock_feed_info_minimal_free(&feed_buffer->info);
-			free(feed_buffer);
-			continue;
-		}
-		
-		curl_easy_setopt(feed_handle, CURLOPT_URL, feed_buffer->info.url);
-		curl_easy_setopt(feed_handle, CURLOPT_WRITEDATA, feed_buffer->fp);
-		curl_easy_setopt(feed_handle, CURLOPT_PRIVATE, feed_buffer);
-		CURLMcode mc = curl_multi_add_handle(multi, feed_handle);
-		if (mc) {
-			log_error("Unable to retrieve feed: %s", curl_multi_strerror(mc));
-			curl_easy_cleanup(feed_handle);
-			fclose(feed_buffer->fp);
-			free(feed_buffer->buf);
-			zblock_feed_info_minimal_free(&feed_buffer->info);
-			free(feed_buffer);
-			continue;
-		}
-		curl_multi_perform(multi, &running_handles);
-	}
-	
-	int successful_feeds = 0;
-	// it's time
-	do {
-		CURLMcode mc = curl_multi_perform(multi, &running_handles);
-		CURLMsg *msg;
-		int msgs_in_queue;
-		do {
-			msg = curl_multi_info_read(multi, &msgs_in_queue);
-			if (msg && msg->msg == CURLMSG_DONE) {
-				CURL *handle = msg->easy_handle;
-				// get our buffer out
-				zblock_feed_buffer *feed_buffer;
-				curl_easy_getinfo(handle, CURLINFO_PRIVATE, &feed_buffer);
-				fclose(feed_buffer->fp); // close the file descriptor for the buffer (also flushes buffer)
-				if (!msg->data.result) {
-					// hell yeah parse that RSS feed
-					mrss_t *mrss_feed;
-					mrss_error_t mrss_err = mrss_parse_buffer(feed_buffer->buf, feed_buffer->bufsize, &mrss_feed);
-					if (!mrss_err) {
-						++successful_feeds;
-						// get publication date of entries and send any new ones
-						time_t last_pubDate_time = pubDate_to_time_t(feed_buffer->info.last_pubDate);
-						mrss_item_t *item = mrss_feed->item;
-						bool update_pubDate = false;
-						while (item && pubDate_to_time_t(item->pubDate) > last_pubDate_time) {
-							update_pubDate = true;
-							
-							// Send new entry in the feed
-							char msg[DISCORD_MAX_MESSAGE_LEN];
-							snprintf(msg, sizeof(msg), "### %s\n[%s](%s)", mrss_feed->title, item->title, item->link);
-							struct discord_create_message res = { .content = msg };
-							discord_create_message(client, feed_buffer->info.channel_id, &res, NULL);
-							item = item->next;
-						}
-						
-						if (update_pubDate) {
-							zblock_feed_info_minimal updated_feed = feed_buffer->info;
-							updated_feed.last_pubDate = mrss_feed->item->pubDate;
-							zblock_feed_info_update(database_conn, &updated_feed);
-						}
-						
-						// done with our feed!
-						mrss_free(mrss_feed);
-					} else {
-						log_error("Error parsing feed at %s: %s\n", feed_buffer->info.url, mrss_strerror(mrss_err));
-					}
-				} else {
-					log_error("Error downloading RSS feed at %s: %s\n", feed_buffer->info.url, curl_easy_strerror(msg->data.result));
-				}
-				
-				// free our buffers
-				curl_multi_remove_handle(multi, handle);
-				curl_easy_cleanup(handle);
-				free(feed_buffer->buf);
-				zblock_feed_info_minimal_free(&feed_buffer->info);
-				free(feed_buffer);
-			}
-		} while (msg);
-		
-		if (!mc && running_handles) {
-			mc = curl_multi_poll(multi, NULL, 0, 300, NULL);
-		}
-		if (mc) {
-			// figure out how to free all resources instead of crashing
-			log_fatal("curl_multi_poll(): %s", curl_multi_strerror(mc));
-			exit(1);
-		}
-	} while (running_handles);
+static void timer_retrieve_feeds(struct discord *client, struct discord_timer *timer) {
+	// not doing anything with these
+	(void) client;
+	(void) timer;
 	
-	// processing is done
-	curl_multi_cleanup(multi);
-	PQfinish(database_conn);
-	log_info("Retrieved %d of %d feeds!", successful_feeds, total_feeds);
-	return NULL;
+	zblock_poller_signal();
 }
 
-static void timer_retrieve_feeds(struct discord *client, struct discord_timer *timer) {
-	// not doing anything with the timer
+static void timer_write_metrics(struct discord *client, struct discord_timer *timer) {
+	// not doing anything with these
+	(void) client;
 	(void) timer;
 	
-	pthread_t retrieve_thread;
-	pthread_create(&retrieve_thread, NULL, &thread_retrieve_feeds, client);
+	zblock_metrics_err error = zblock_metrics_write(zblock_config.metrics_file);
+	if (error) log_warn("%s %s: %s", zblock_metrics_strerror(error), zblock_config.metrics_file, strerror(errno));
 }
 
 static void timer_tuesday_event(struct discord *client, struct discord_timer *timer) {
@@ -229,40 +89,117 @@ static void timer_tuesday_event(struct discord *client, struct discord_timer *ti
 	discord_create_message(client, zblock_config.tuesday_channel, &msg, NULL);
 }
 
-static void bot_command_add(struct discord *client, const struct discord_interaction *event) {
-	char msg[DISCORD_MAX_MESSAGE_LEN];
-	zblock_feed_info feed;
-	
-	feed.url = event->data->options->array[0].value;
-	feed.channel_id = event->channel_id;
-	feed.guild_id = event->guild_id;
+// everything a worker needs to answer an interaction, since the event is freed as soon as the handler returns
+struct interaction_job {
+	Arena *arena; // holds the job itself and anything built to answer it
+	uint64_t created; // from zblock_metrics_now
+	struct discord *client;
+	u64snowflake id;
+	u64snowflake application_id;
+	char *token;
+	u64snowflake channel_id;
+	u64snowflake guild_id;
+	char *arg; // the url option of a command or the custom_id of a button
+};
 
-	// check if the feed already exists
-	{
-		int feed_exists;
-		zblock_feed_info_err exists_error = zblock_feed_info_exists(database_conn, feed.url, feed.channel_id, &feed_exists);
-		if (exists_error) {
-			snprintf(msg, sizeof(msg), "Error adding feed: %s", zblock_feed_info_strerror(exists_error));
-			goto send_msg;
-		} else if (feed_exists) {
-			snprintf(msg, sizeof(msg), "Error adding feed: It has already been added to this channel");
-			goto send_msg;
-		}
+static void interaction_job_free(struct interaction_job *job) {
+	if (!job) return;
+	// a job is freed once it has been answered
+	zblock_metrics_observe_since(ZBLOCK_METRIC_INTERACTION_DURATION, job->created);
+	zblock_arena_pool_checkin(job->arena);
+}
+
+static struct interaction_job *interaction_job_new(struct discord *client, const struct discord_interaction *event, const char *arg) {
+	// everything comes out of a pooled arena so answering an interaction doesn't need to touch the heap
+	Arena *arena = zblock_arena_pool_checkout();
+	if (!arena) return NULL;
+	struct interaction_job *job = Arena_alloc(arena, sizeof(*job));
+	if (!job) {
+		zblock_arena_pool_checkin(arena);
+		return NULL;
 	}
 	
-	mrss_t *mrss_feed;
-	mrss_error_t mrss_error = mrss_parse_url(feed.url, &mrss_feed);
-	if (mrss_error) {
-		snprintf(msg, sizeof(msg), "Error adding feed: %s", mrss_strerror(mrss_error));
-		goto send_msg;
+	*job = (struct interaction_job) {
+		.arena = arena,
+		.created = zblock_metrics_now(),
+		.client = client,
+		.id = event->id,
+		.application_id = event->application_id,
+		.token = Arena_copy(arena, event->token, strlen(event->token) + 1),
+		.channel_id = event->channel_id,
+		.guild_id = event->guild_id,
+		.arg = arg ? Arena_copy(arena, arg, strlen(arg) + 1) : NULL
+	};
+	if (!job->token || (arg && !job->arg)) {
+		interaction_job_free(job);
+		return NULL;
 	}
 	
-	feed.title = mrss_feed->title;
-	// if there are no entries, we can't just give it the invalid pointer
-	feed.last_pubDate = mrss_feed->item ? mrss_feed->item->pubDate : "Never";
+	return job;
+}
+
+static void interaction_job_respond(struct interaction_job *job, struct discord_interaction_response *res) {
+	discord_create_interaction_response(job->client, job->id, job->token, res, RESPONSE_HIGH_PRIORITY);
+}
+
+// replaces the message of an interaction that was deferred
+static void interaction_job_edit(struct interaction_job *job, char *content) {
+	struct discord_edit_original_interaction_response params = {
+		.content = content
+	};
+	discord_edit_original_interaction_response(job->client, job->application_id, job->token, &params, EDIT_HIGH_PRIORITY);
+}
+
+// hands an interaction off to a database worker so the gateway isn't held up. answers right away if that fails.
+static void interaction_submit(struct discord *client, const struct discord_interaction *event, const char *arg, zblock_db_job job_func) {
+	struct interaction_job *job = interaction_job_new(client, event, arg);
+	zblock_db_worker_err error = job ? zblock_db_worker_submit(job_func, job) : ZBLOCK_DB_WORKER_NOMEM;
+	if (!error) return;
 	
-	zblock_feed_info_err insert_res = zblock_feed_info_insert(database_conn, &feed);
-	if (insert_res) {
+	interaction_job_free(job);
+	log_error("Unable to queue interaction: %s", zblock_db_worker_strerror(error));
+	char msg[DISCORD_MAX_MESSAGE_LEN];
+	snprintf(msg, sizeof(msg), "Error: %s", zblock_db_worker_strerror(error));
+	struct discord_interaction_response res = {
+		.type = DISCORD_INTERACTION_CHANNEL_MESSAGE_WITH_SOURCE,
+		.data = &(struct discord_interaction_callback_data) {
+			.content = msg
+		}
+	};
+	discord_create_interaction_response(client, event->id, event->token, &res, RESPONSE_HIGH_PRIORITY);
+}
+
+// a feed that has been fetched for /add and is waiting to be inserted
+struct add_job {
+	struct interaction_job *job;
+	time_t last_pubDate;
+	char title[];
+};
+
+static void job_add_insert(void *data) {
+	struct add_job *add = data;
+	struct interaction_job *job = add->job;
+	char msg[DISCORD_MAX_MESSAGE_LEN];
+	
+	/* The url is stored as it was given, not where it redirected to.
+	 * The poller follows the same redirects, and a temporary one would otherwise become permanent. */
+	zblock_feed_info feed = {
+		.url = job->arg,
+		.channel_id = job->channel_id,
+		.guild_id = job->guild_id,
+		// some feeds don't have a title
+		.title = *add->title ? add->title : job->arg,
+		.last_pubDate = add->last_pubDate
+	};
+	
+	PGconn *database_conn = zblock_db_pool_checkout();
+	zblock_feed_info_err insert_res = database_conn ? zblock_feed_info_insert(database_conn, &feed) : ZBLOCK_FEED_INFO_DBERROR;
+	zblock_db_pool_checkin(database_conn);
+	if (!insert_res) zblock_list_cache_invalidate_channel(job->channel_id);
+	if (insert_res == ZBLOCK_FEED_INFO_EXISTS) {
+		// another /add for it got in while this one was fetching
+		snprintf(msg, sizeof(msg), "Error adding feed: It has already been added to this channel");
+	} else if (insert_res) {
 		// write error message
 		snprintf(msg, sizeof(msg), "Error adding feed: %s", zblock_feed_info_strerror(insert_res));
 	} else {
@@ -270,24 +207,131 @@ static void bot_command_add(struct discord *client, const struct discord_interac
 		snprintf(msg, sizeof(msg), "The following feed has been successfully added to this channel:\n`%s`", feed.url);
 	}
 	
-	mrss_free(mrss_feed);
+	interaction_job_edit(job, msg);
+	interaction_job_free(job);
+}
+
+// called on the fetch thread once the feed has been checked
+static void add_fetched(void *userdata, const zblock_feed_fetch_result *result) {
+	struct interaction_job *job = userdata;
+	char msg[DISCORD_MAX_MESSAGE_LEN];
+	if (result->error) {
+		snprintf(msg, sizeof(msg), "Error adding feed: %s", result->error);
+		interaction_job_edit(job, msg);
+		interaction_job_free(job);
+		return;
+	}
+	
+	// back to a worker for the insert
+	size_t title_size = strlen(result->title) + 1;
+	// nothing else is using the job's arena while the fetch is running
+	struct add_job *add = Arena_alloc(job->arena, sizeof(*add) + title_size);
+	zblock_db_worker_err error = ZBLOCK_DB_WORKER_NOMEM;
+	if (add) {
+		add->job = job;
+		// if there are no entries, nothing has been sent yet
+		add->last_pubDate = result->last_pubDate;
+		memcpy(add->title, result->title, title_size);
+		error = zblock_db_worker_submit(&job_add_insert, add);
+	}
+	
+	if (error) {
+		snprintf(msg, sizeof(msg), "Error adding feed: %s", zblock_db_worker_strerror(error));
+		interaction_job_edit(job, msg);
+		interaction_job_free(job);
+	}
+}
+
+static void job_add(void *data) {
+	struct interaction_job *job = data;
+	char msg[DISCORD_MAX_MESSAGE_LEN];
+
+	// check if the feed already exists
+	int feed_exists;
+	PGconn *database_conn = zblock_db_pool_checkout();
+	zblock_feed_info_err exists_error = database_conn ? zblock_feed_info_exists(database_conn, job->arg, job->channel_id, &feed_exists) : ZBLOCK_FEED_INFO_DBERROR;
+	zblock_db_pool_checkin(database_conn);
+	if (exists_error) {
+		snprintf(msg, sizeof(msg), "Error adding feed: %s", zblock_feed_info_strerror(exists_error));
+	} else if (feed_exists) {
+		snprintf(msg, sizeof(msg), "Error adding feed: It has already been added to this channel");
+	} else {
+		// make sure it's actually a feed without tying up this worker while it downloads
+		zblock_feed_fetch_err fetch_error = zblock_feed_fetch(job->arg, &add_fetched, job);
+		if (!fetch_error) return;
+		snprintf(msg, sizeof(msg), "Error adding feed: %s", zblock_feed_fetch_strerror(fetch_error));
+	}
 	
-	send_msg:
+	interaction_job_edit(job, msg);
+	interaction_job_free(job);
+}
+
+// the deferral has been accepted, so the edits that answer the command can't get to discord before it
+static void add_deferred(struct discord *client, struct discord_response *resp, const struct discord_interaction_response *res) {
+	(void) client;
+	(void) res;
+	
+	struct interaction_job *job = resp->data;
+	zblock_db_worker_err error = zblock_db_worker_submit(&job_add, job);
+	if (error) {
+		char msg[DISCORD_MAX_MESSAGE_LEN];
+		snprintf(msg, sizeof(msg), "Error adding feed: %s", zblock_db_worker_strerror(error));
+		interaction_job_edit(job, msg);
+		interaction_job_free(job);
+	}
+}
+
+// there's no message to edit without the deferral, so all that can be done is log it
+static void add_defer_failed(struct discord *client, struct discord_response *resp) {
+	(void) client;
+	
+	struct interaction_job *job = resp->data;
+	log_error("Unable to defer /add for %s (error %d)", job->arg, resp->code);
+	interaction_job_free(job);
+}
+
+static void bot_command_add(struct discord *client, const struct discord_interaction *event) {
+	struct interaction_job *job = interaction_job_new(client, event, event->data->options->array[0].value);
+	if (!job) {
+		char msg[DISCORD_MAX_MESSAGE_LEN];
+		snprintf(msg, sizeof(msg), "Error adding feed: %s", zblock_db_worker_strerror(ZBLOCK_DB_WORKER_NOMEM));
+		struct discord_interaction_response res = {
+			.type = DISCORD_INTERACTION_CHANNEL_MESSAGE_WITH_SOURCE,
+			.data = &(struct discord_interaction_callback_data) {
+				.content = msg
+			}
+		};
+		discord_create_interaction_response(client, event->id, event->token, &res, RESPONSE_HIGH_PRIORITY);
+		return;
+	}
+	
+	/* Fetching the feed can easily take longer than discord waits for a response.
+	 * The edit and the deferral are sent on different routes, so the job only starts once the deferral is through. */
 	struct discord_interaction_response res = {
-		.type = DISCORD_INTERACTION_CHANNEL_MESSAGE_WITH_SOURCE,
-		.data = &(struct discord_interaction_callback_data) {
-			.content = msg
-		}
+		.type = DISCORD_INTERACTION_DEFERRED_CHANNEL_MESSAGE_WITH_SOURCE
 	};
-
-	discord_create_interaction_response(client, event->id, event->token, &res, NULL);
+	struct discord_ret_interaction_response ret = {
+		.done = &add_deferred,
+		.fail = &add_defer_failed,
+		.data = job,
+		.high_priority = true
+	};
+	CCORDcode code = discord_create_interaction_response(client, event->id, event->token, &res, &ret);
+	if (code) {
+		log_error("Unable to defer /add for %s (error %d)", job->arg, code);
+		interaction_job_free(job);
+	}
 }
 
-static void bot_command_remove(struct discord *client, const struct discord_interaction *event) {
+static void job_remove(void *data) {
+	struct interaction_job *job = data;
 	char msg[DISCORD_MAX_MESSAGE_LEN];
 		
-	char *url = event->data->options->array[0].value;
-	zblock_feed_info_err error = zblock_feed_info_delete(database_conn, url, event->channel_id);
+	char *url = job->arg;
+	PGconn *database_conn = zblock_db_pool_checkout();
+	zblock_feed_info_err error = database_conn ? zblock_feed_info_delete(database_conn, url, job->channel_id) : ZBLOCK_FEED_INFO_DBERROR;
+	zblock_db_pool_checkin(database_conn);
+	if (!error) zblock_list_cache_invalidate_channel(job->channel_id);
 	if (error) {
 		// write error message
 		snprintf(msg, sizeof(msg), "Error removing feed: %s", zblock_feed_info_strerror(error));
@@ -303,64 +347,162 @@ static void bot_command_remove(struct discord *client, const struct discord_inte
 		}
 	};
 
-	discord_create_interaction_response(client, event->id, event->token, &res, NULL);
+	interaction_job_respond(job, &res);
+	interaction_job_free(job);
+}
+
+static void bot_command_remove(struct discord *client, const struct discord_interaction *event) {
+	interaction_submit(client, event, event->data->options->array[0].value, &job_remove);
 }
 
 #define LIST_PAGE_SIZE 5
 
-// The arena everything gets allocated to will be returned in the arena pointer
-static struct discord_interaction_callback_data *list_data_create(u64snowflake channel_id, int page_number, Arena **arena) {
+// button ids carry where the page starts and the feed count, so moving between pages never has to count or skip rows
+#define LIST_BACK_ID "list_before:%" PRId64 ":%d:%" PRId64
+#define LIST_NEXT_ID "list_after:%" PRId64 ":%d:%" PRId64
+#define LIST_BACK_ID_SCAN "list_before:%" SCNd64 ":%d:%" SCNd64
+#define LIST_NEXT_ID_SCAN "list_after:%" SCNd64 ":%d:%" SCNd64
+
+/* Gets a page from the cache, or from the database if it isn't cached. A connection is only checked out into conn if it's needed.
+ * The feeds end up in arena either way, so they never have to be freed. */
+static zblock_feed_info_err list_page_get(Arena *arena, PGconn **conn, u64snowflake channel_id, int64_t cursor, bool before, zblock_feed_info *feeds, int *num_retrieved) {
+	if (zblock_list_cache_get(arena, channel_id, cursor, before, feeds, LIST_PAGE_SIZE, num_retrieved)) return ZBLOCK_FEED_INFO_OK;
+	
+	uint64_t generation = zblock_list_cache_generation();
+	if (!*conn) *conn = zblock_db_pool_checkout();
+	if (!*conn) return ZBLOCK_FEED_INFO_DBERROR;
+	zblock_feed_info_err error = zblock_feed_info_retrieve_page_channel(*conn, channel_id, cursor, before, LIST_PAGE_SIZE, feeds, num_retrieved);
+	if (error) return error;
+	zblock_list_cache_put(generation, channel_id, cursor, before, feeds, *num_retrieved);
+	
+	// move the rows into the arena so they're owned the same way as a cached page
+	for (int i = 0; i < *num_retrieved; ++i) {
+		zblock_feed_info row = feeds[i];
+		feeds[i].url = Arena_copy(arena, row.url, strlen(row.url) + 1);
+		feeds[i].title = Arena_copy(arena, row.title, strlen(row.title) + 1);
+		zblock_feed_info_free(&row);
+		if (!feeds[i].url || !feeds[i].title) error = ZBLOCK_FEED_INFO_NOMEM;
+	}
+	return error;
+}
+
+// a page that will probably be asked for next
+struct list_prefetch {
+	Arena *arena; // holds the prefetch itself and the page
+	u64snowflake channel_id;
+	int64_t cursor;
+	bool before;
+};
+
+static void job_list_prefetch(void *data) {
+	struct list_prefetch *prefetch = data;
+	zblock_feed_info feeds[LIST_PAGE_SIZE];
+	int num_retrieved;
+	PGconn *database_conn = NULL;
+	list_page_get(prefetch->arena, &database_conn, prefetch->channel_id, prefetch->cursor, prefetch->before, feeds, &num_retrieved);
+	zblock_db_pool_checkin(database_conn);
+	zblock_arena_pool_checkin(prefetch->arena);
+}
+
+// caches the page the buttons lead to in the direction the user is going. it's only a guess, so failing is fine.
+static void list_prefetch(u64snowflake channel_id, int64_t cursor, bool before) {
+	// out of a pooled arena like the interactions, so a prefetch doesn't touch the heap either
+	Arena *arena = zblock_arena_pool_checkout();
+	if (!arena) return;
+	struct list_prefetch *prefetch = Arena_alloc(arena, sizeof(*prefetch));
+	if (!prefetch) {
+		zblock_arena_pool_checkin(arena);
+		return;
+	}
+	*prefetch = (struct list_prefetch) {
+		.arena = arena,
+		.channel_id = channel_id,
+		.cursor = cursor,
+		.before = before
+	};
+	if (zblock_db_worker_submit(&job_list_prefetch, prefetch)) zblock_arena_pool_checkin(arena);
+}
+
+/* Creates the page of the list right after (or before) the feed with the id in cursor.
+ * A count below 0 gets the count from the database, which only needs to happen for the first page.
+ * Everything is allocated in the arena provided, which should be the interaction job's. */
+static struct discord_interaction_callback_data *list_data_create(Arena *arena, u64snowflake channel_id, int64_t cursor, bool before, int page_number, int64_t count) {
 	assert(arena && "No arena provided"); // this is programmer error
 	// clamp page number
 	page_number = page_number < 1 ? 1 : page_number;
 	
-	*arena = Arena_new(8192); // this should be more than enough
-	struct discord_interaction_callback_data *data = Arena_allocz(*arena, sizeof(*data));
+	struct discord_interaction_callback_data *data = Arena_allocz(arena, sizeof(*data));
 	
-	int64_t count;
-	zblock_feed_info_err error = zblock_feed_info_count_channel(database_conn, channel_id, &count);
-	if (error) {
-		char *msg = Arena_alloc(*arena, sizeof(DISCORD_MAX_MESSAGE_LEN));
-		snprintf(msg, DISCORD_MAX_MESSAGE_LEN, "Error creating list: %s", zblock_feed_info_strerror(error));
-		data->content = msg;
-		return data;
+	// button presses usually never need a connection since the count is in the button and the page is cached
+	PGconn *database_conn = NULL;
+	zblock_feed_info_err error = ZBLOCK_FEED_INFO_OK;
+	bool stale_count = count >= 0;
+	if (count < 0) {
+		database_conn = zblock_db_pool_checkout();
+		error = database_conn ? zblock_feed_info_count_channel(database_conn, channel_id, &count) : ZBLOCK_FEED_INFO_DBERROR;
 	}
 	
-	int last_page_number = count ? count % LIST_PAGE_SIZE ? count / LIST_PAGE_SIZE + 1 : count / LIST_PAGE_SIZE : 1;
-	
 	zblock_feed_info feeds[LIST_PAGE_SIZE];
-	int num_retrieved;
-	error = zblock_feed_info_retrieve_chunk_channel(database_conn, channel_id, (page_number - 1) * LIST_PAGE_SIZE, LIST_PAGE_SIZE, feeds, &num_retrieved);
+	int num_retrieved = 0;
+	if (!error) error = list_page_get(arena, &database_conn, channel_id, cursor, before, feeds, &num_retrieved);
+	// feeds were removed since the list was made and there isn't a full page before this one anymore, so start over
+	if (!error && before && num_retrieved < LIST_PAGE_SIZE) {
+		page_number = 1;
+		before = false;
+		error = list_page_get(arena, &database_conn, channel_id, 0, false, feeds, &num_retrieved);
+	}
+	/* The count in the buttons is from when the list was opened, so a full page where it says the list ends
+	 * may have feeds added after it since. Look at the next page to be sure, which also caches it for the next button. */
+	bool next_cached = false;
+	if (!error && stale_count && !before && num_retrieved == LIST_PAGE_SIZE && (int64_t) page_number * LIST_PAGE_SIZE >= count) {
+		zblock_feed_info next[LIST_PAGE_SIZE];
+		int num_next;
+		if (!list_page_get(arena, &database_conn, channel_id, feeds[num_retrieved - 1].id, false, next, &num_next)) {
+			// there could be even more past that, the next page checks again
+			if (num_next) count = (int64_t) page_number * LIST_PAGE_SIZE + num_next;
+			next_cached = true;
+		}
+	}
+	zblock_db_pool_checkin(database_conn);
 	if (error) {
-		char *msg = Arena_alloc(*arena, sizeof(DISCORD_MAX_MESSAGE_LEN));
+		char *msg = Arena_alloc(arena, DISCORD_MAX_MESSAGE_LEN);
 		snprintf(msg, DISCORD_MAX_MESSAGE_LEN, "Error creating list: %s", zblock_feed_info_strerror(error));
 		data->content = msg;
 		return data;
 	}
 	
+	int last_page_number = count ? count % LIST_PAGE_SIZE ? count / LIST_PAGE_SIZE + 1 : count / LIST_PAGE_SIZE : 1;
+	// the count is only as fresh as the first page, so trust what was actually retrieved
+	if (page_number > last_page_number) last_page_number = page_number;
+	bool has_next = num_retrieved == LIST_PAGE_SIZE && page_number < last_page_number;
+	int64_t first_id = num_retrieved ? feeds[0].id : cursor;
+	int64_t last_id = num_retrieved ? feeds[num_retrieved - 1].id : cursor;
+	if (before && page_number > 1) list_prefetch(channel_id, first_id, true);
+	else if (!before && has_next && !next_cached) list_prefetch(channel_id, last_id, false);
+	
 	// create our components starting with the action row
-	data->components = Arena_alloc(*arena, sizeof(*data->components));
+	data->components = Arena_alloc(arena, sizeof(*data->components));
 	data->components->size = 1;
-	data->components->array = Arena_allocz(*arena, data->components->size * sizeof(*data->components->array));
+	data->components->array = Arena_allocz(arena, data->components->size * sizeof(*data->components->array));
 	struct discord_component *action_row = data->components->array;
 	action_row->type = DISCORD_COMPONENT_ACTION_ROW;
 	// create buttons
-	action_row->components = Arena_alloc(*arena, sizeof(*action_row->components));
+	action_row->components = Arena_alloc(arena, sizeof(*action_row->components));
 	action_row->components->size = 2;
-	action_row->components->array = Arena_allocz(*arena, action_row->components->size * sizeof(*action_row->components->array));
+	action_row->components->array = Arena_allocz(arena, action_row->components->size * sizeof(*action_row->components->array));
 	struct discord_component *buttons = action_row->components->array;
 	// create emojis
-	struct discord_emoji *back_arrow = Arena_allocz(*arena, sizeof(*back_arrow));
+	struct discord_emoji *back_arrow = Arena_allocz(arena, sizeof(*back_arrow));
 	back_arrow->name = "◀️";
-	struct discord_emoji *next_arrow = Arena_allocz(*arena, sizeof(*next_arrow));
+	struct discord_emoji *next_arrow = Arena_allocz(arena, sizeof(*next_arrow));
 	next_arrow->name = "▶️";
 	// create button ids
-	int back_id_size = snprintf(NULL, 0, "list_page%d", page_number - 1) + 1;
-	char *back_id = Arena_alloc(*arena, back_id_size);
-	snprintf(back_id, back_id_size, "list_page%d", page_number - 1);
-	int next_id_size = snprintf(NULL, 0, "list_page%d", page_number + 1) + 1;
-	char *next_id = Arena_alloc(*arena, next_id_size);
-	snprintf(next_id, next_id_size, "list_page%d", page_number + 1);
+	int back_id_size = snprintf(NULL, 0, LIST_BACK_ID, first_id, page_number - 1, count) + 1;
+	char *back_id = Arena_alloc(arena, back_id_size);
+	snprintf(back_id, back_id_size, LIST_BACK_ID, first_id, page_number - 1, count);
+	int next_id_size = snprintf(NULL, 0, LIST_NEXT_ID, last_id, page_number + 1, count) + 1;
+	char *next_id = Arena_alloc(arena, next_id_size);
+	snprintf(next_id, next_id_size, LIST_NEXT_ID, last_id, page_number + 1, count);
 	// populate buttons
 	buttons[0] = (struct discord_component) {
 		.type = DISCORD_COMPONENT_BUTTON,
@@ -372,7 +514,7 @@ static struct discord_interaction_callback_data *list_data_create(u64snowflake c
 	};
 	buttons[1] = (struct discord_component) {
 		.type = DISCORD_COMPONENT_BUTTON,
-		.disabled = page_number == last_page_number,
+		.disabled = !has_next,
 		.style = DISCORD_BUTTON_SECONDARY,
 		.custom_id = next_id,
 		.label = "Next",
@@ -380,29 +522,32 @@ static struct discord_interaction_callback_data *list_data_create(u64snowflake c
 	};
 	
 	// create embed
-	data->embeds = Arena_alloc(*arena, sizeof(*data->embeds));
+	data->embeds = Arena_alloc(arena, sizeof(*data->embeds));
 	data->embeds->size = 1;
-	data->embeds->array = Arena_allocz(*arena, data->embeds->size * sizeof(*data->embeds->array));
+	data->embeds->array = Arena_allocz(arena, data->embeds->size * sizeof(*data->embeds->array));
 	struct discord_embed *embed = data->embeds->array;
 	int embed_title_size = snprintf(NULL, 0, "Feed List (Page %d of %d)", page_number, last_page_number) + 1;
-	char *embed_title = Arena_alloc(*arena, embed_title_size);
+	char *embed_title = Arena_alloc(arena, embed_title_size);
 	snprintf(embed_title, embed_title_size, "Feed List (Page %d of %d)", page_number, last_page_number);
 	
 	// write the description
 	char *embed_description;
-	if (count) {
-		embed_description = Arena_alloc(*arena, 4096); // the current max size of embed descriptions
+	if (num_retrieved) {
+		embed_description = Arena_alloc(arena, 4096); // the current max size of embed descriptions
 		int embed_description_size = 0;
 		for (int i = 0; i < num_retrieved; ++i) {
 			// in case somebody has maliciously long text in their feed
 			if (embed_description_size < 4096) {
+				// discord shows the date in each user's own timezone
+				char last_updated[32] = "Never";
+				if (feeds[i].last_pubDate) snprintf(last_updated, sizeof(last_updated), "<t:%" PRId64 ":f>", (int64_t) feeds[i].last_pubDate);
 				embed_description_size += snprintf(embed_description + embed_description_size, 4096 - embed_description_size,
 					"### %d. %s\n" // feed title
 					"Link: %s\n" // feed url
 					"Last updated: %s\n", // last_pubDate
 					(page_number - 1) * LIST_PAGE_SIZE + i + 1, feeds[i].title,
 					feeds[i].url,
-					feeds[i].last_pubDate
+					last_updated
 				);
 			}
 		}
@@ -419,29 +564,46 @@ static struct discord_interaction_callback_data *list_data_create(u64snowflake c
 	return data;
 }
 
-static void bot_command_list(struct discord *client, const struct discord_interaction *event) {
-	Arena *arena;
+static void job_list(void *data) {
+	struct interaction_job *job = data;
 	struct discord_interaction_response res = {
 		.type = DISCORD_INTERACTION_CHANNEL_MESSAGE_WITH_SOURCE,
-		.data = list_data_create(event->channel_id, 1, &arena)
+		.data = list_data_create(job->arena, job->channel_id, 0, false, 1, -1)
 	};
 
-	discord_create_interaction_response(client, event->id, event->token, &res, NULL);
-	Arena_delete(arena);
+	interaction_job_respond(job, &res);
+	interaction_job_free(job);
 }
 
-static void list_update(struct discord *client, const struct discord_interaction *event) {
-	int page_number;
-	sscanf(event->data->custom_id, "list_page%d", &page_number);
+static void bot_command_list(struct discord *client, const struct discord_interaction *event) {
+	interaction_submit(client, event, NULL, &job_list);
+}
+
+static void job_list_update(void *data) {
+	struct interaction_job *job = data;
+	int64_t cursor = 0, count = -1;
+	int page_number = 1;
+	bool before = false;
+	if (sscanf(job->arg, LIST_BACK_ID_SCAN, &cursor, &page_number, &count) == 3) {
+		before = true;
+	} else if (sscanf(job->arg, LIST_NEXT_ID_SCAN, &cursor, &page_number, &count) != 3) {
+		// buttons from older versions only had a page number, so just go back to the start
+		cursor = 0;
+		page_number = 1;
+		count = -1;
+	}
 
-	Arena *arena;
 	struct discord_interaction_response res = {
 		.type = DISCORD_INTERACTION_UPDATE_MESSAGE,
-		.data = list_data_create(event->channel_id, page_number, &arena)
+		.data = list_data_create(job->arena, job->channel_id, cursor, before, page_number, count)
 	};
 
-	discord_create_interaction_response(client, event->id, event->token, &res, NULL);
-	Arena_delete(arena);
+	interaction_job_respond(job, &res);
+	interaction_job_free(job);
+}
+
+static void list_update(struct discord *client, const struct discord_interaction *event) {
+	interaction_submit(client, event, event->data->custom_id, &job_list_update);
 }
 
 static bool acceptchars(int c, const char *accept) {
@@ -469,7 +631,7 @@ static void bot_command_story(struct discord *client, const struct discord_inter
 			}
 		};
 		
-		discord_create_interaction_response(client, event->id, event->token, &res, NULL);
+		discord_create_interaction_response(client, event->id, event->token, &res, RESPONSE_HIGH_PRIORITY);
 		return;
 	}
 	
@@ -499,7 +661,7 @@ static void bot_command_story(struct discord *client, const struct discord_inter
 			.content = story_content_last != story_content ? story_content : "Sorry, I don't have a story for you."
 		}
 	};
-	discord_create_interaction_response(client, event->id, event->token, &res, NULL);
+	discord_create_interaction_response(client, event->id, event->token, &res, RESPONSE_HIGH_PRIORITY);
 	
 }
 
@@ -522,7 +684,7 @@ static void bot_command_help(struct discord *client, const struct discord_intera
 		}
 	};
 
-	discord_create_interaction_response(client, event->id, event->token, &res, NULL);
+	discord_create_interaction_response(client, event->id, event->token, &res, RESPONSE_HIGH_PRIORITY);
 }
 
 static struct bot_command commands[] = {
@@ -593,7 +755,7 @@ static void on_ready(struct discord *client, const struct discord_ready *event)
 	}
 }
 
-static void on_interaction(struct discord *client, const struct discord_interaction *event) {
+static void dispatch_interaction(struct discord *client, const struct discord_interaction *event) {
 	switch (event->type) {
 		case DISCORD_INTERACTION_APPLICATION_COMMAND: {
 			// invoke the command
@@ -611,7 +773,7 @@ static void on_interaction(struct discord *client, const struct discord_interact
 					.content = "Invalid command, contact the maintainer of this bot."
 				}
 			};
-			discord_create_interaction_response(client, event->id, event->token, &res, NULL);		
+			discord_create_interaction_response(client, event->id, event->token, &res, RESPONSE_HIGH_PRIORITY);		
 		} break;
 		case DISCORD_INTERACTION_MESSAGE_COMPONENT: { // only the list command is used here so far
 			list_update(client, event);
@@ -621,16 +783,52 @@ static void on_interaction(struct discord *client, const struct discord_interact
 
 }
 
+static void on_interaction(struct discord *client, const struct discord_interaction *event) {
+	uint64_t start = zblock_metrics_now();
+	dispatch_interaction(client, event);
+	zblock_metrics_observe_since(ZBLOCK_METRIC_INTERACTION_DISPATCH, start);
+}
+
+static void job_delete_all_guild(void *data) {
+	u64snowflake *guild_id = data;
+	PGconn *database_conn = zblock_db_pool_checkout();
+	zblock_feed_info_err error = database_conn ? zblock_feed_info_delete_all_guild(database_conn, *guild_id) : ZBLOCK_FEED_INFO_DBERROR;
+	zblock_db_pool_checkin(database_conn);
+	zblock_list_cache_invalidate_guild(*guild_id);
+	if (error) {
+		log_error("Unable to delete all feeds from guild %" PRIu64 ". You probably want to clean this up.", *guild_id);
+	}
+	free(guild_id);
+}
+
 static void on_guild_delete(struct discord *client, const struct discord_guild *event) {
 	(void) client;
-	if (zblock_feed_info_delete_all_guild(database_conn, event->id)) {
+	u64snowflake *guild_id = malloc(sizeof(*guild_id));
+	if (guild_id) *guild_id = event->id;
+	if (!guild_id || zblock_db_worker_submit(&job_delete_all_guild, guild_id)) {
+		free(guild_id);
 		log_error("Unable to delete all feeds from guild %" PRIu64 ". You probably want to clean this up.", event->id);
 	}
 }
 
+static void job_delete_all_channel(void *data) {
+	u64snowflake *channel_id = data;
+	PGconn *database_conn = zblock_db_pool_checkout();
+	zblock_feed_info_err error = database_conn ? zblock_feed_info_delete_all_channel(database_conn, *channel_id) : ZBLOCK_FEED_INFO_DBERROR;
+	zblock_db_pool_checkin(database_conn);
+	zblock_list_cache_invalidate_channel(*channel_id);
+	if (error) {
+		log_error("Unable to delete all feeds from channel %" PRIu64 ". You probably want to clean this up.", *channel_id);
+	}
+	free(channel_id);
+}
+
 static void on_channel_delete(struct discord *client, const struct discord_channel *event) {
 	(void) client;
-	if (zblock_feed_info_delete_all_channel(database_conn, event->id)) {
+	u64snowflake *channel_id = malloc(sizeof(*channel_id));
+	if (channel_id) *channel_id = event->id;
+	if (!channel_id || zblock_db_worker_submit(&job_delete_all_channel, channel_id)) {
+		free(channel_id);
 		log_error("Unable to delete all feeds from channel %" PRIu64 ". You probably want to clean this up.", event->id);
 	}
 }
@@ -638,8 +836,8 @@ static void on_channel_delete(struct discord *client, const struct discord_chann
 // delay before the first feed retrieval (in ms)
 #define FEED_TIMER_DELAY 15000
 
-// interval for the feed retrieval timer (in ms)
-#define FEED_TIMER_INTERVAL 600000
+// how often to check for feeds that are due to be polled (in ms)
+#define FEED_TIMER_INTERVAL 60000
 
 // seconds in a day
 #define ONE_DAY_SEC 86400
@@ -650,8 +848,6 @@ static void on_channel_delete(struct discord *client, const struct discord_chann
 int main(void) {
 	int exit_code = 0;	
 	
-	// set locale for time
-	setlocale(LC_ALL, "C");
 	srand(time(NULL));
 	struct discord *client = discord_config_init("config.json");
 
@@ -662,10 +858,73 @@ int main(void) {
 		goto cleanup;
 	}
 	
+	// the table has to be up to date before the pool prepares statements against it
+	{
+		PGconn *migrate_conn = PQconnectdb(zblock_config.conninfo);
+		if (PQstatus(migrate_conn) != CONNECTION_OK) {
+			log_fatal("Failed to connect to database: %s", PQerrorMessage(migrate_conn));
+			PQfinish(migrate_conn);
+			exit_code = 1;
+			goto cleanup;
+		}
+		
+		zblock_feed_info_err migrate_err = zblock_feed_info_migrate(migrate_conn);
+		PQfinish(migrate_conn);
+		if (migrate_err) {
+			log_fatal("Unable to update the feeds table.");
+			exit_code = 1;
+			goto cleanup;
+		}
+	}
+	
 	// connect to database
-	database_conn = PQconnectdb(zblock_config.conninfo);
-	if (!database_conn) {
-		log_fatal("Failed to connect to database.");
+	zblock_db_pool_err pool_err = zblock_db_pool_init(zblock_config.conninfo, zblock_config.db_connections);
+	if (pool_err) {
+		log_fatal("Error connecting to database: %s", zblock_db_pool_strerror(pool_err));
+		exit_code = 1;
+		goto cleanup;
+	}
+	
+	// the poller holds on to one connection, every other one can be used by a worker
+	zblock_db_worker_err worker_err = zblock_db_worker_start(zblock_config.db_connections - 1);
+	if (worker_err) {
+		log_fatal("Error starting database workers: %s", zblock_db_worker_strerror(worker_err));
+		zblock_db_pool_destroy();
+		exit_code = 1;
+		goto cleanup;
+	}
+	
+	// one arena for each interaction a worker can be answering, the pool makes more if they're needed
+	zblock_arena_pool_err arena_err = zblock_arena_pool_init(zblock_config.db_connections);
+	if (arena_err) log_warn("Unable to fill the arena pool: %s", zblock_arena_pool_strerror(arena_err));
+	
+	zblock_feed_fetch_err fetch_err = zblock_feed_fetch_start();
+	if (fetch_err) {
+		log_fatal("Error starting feed fetcher: %s", zblock_feed_fetch_strerror(fetch_err));
+		zblock_db_worker_stop();
+		zblock_db_pool_destroy();
+		exit_code = 1;
+		goto cleanup;
+	}
+	
+	// every feed post goes through the outbox so the poller can't outrun the rate limits
+	zblock_outbox_err outbox_err = zblock_outbox_start(client);
+	if (outbox_err) {
+		log_fatal("Error starting outbox: %s", zblock_outbox_strerror(outbox_err));
+		zblock_feed_fetch_stop();
+		zblock_db_worker_stop();
+		zblock_db_pool_destroy();
+		exit_code = 1;
+		goto cleanup;
+	}
+	
+	zblock_poller_err poller_err = zblock_poller_start();
+	if (poller_err) {
+		log_fatal("Error starting feed poller: %s", zblock_poller_strerror(poller_err));
+		zblock_outbox_stop();
+		zblock_feed_fetch_stop();
+		zblock_db_worker_stop();
+		zblock_db_pool_destroy();
 		exit_code = 1;
 		goto cleanup;
 	}
@@ -678,6 +937,7 @@ int main(void) {
 
 	// register timers
 	discord_timer_interval(client, timer_retrieve_feeds, NULL, NULL, FEED_TIMER_DELAY, FEED_TIMER_INTERVAL, -1);
+	if (zblock_config.metrics_file) discord_timer_interval(client, timer_write_metrics, NULL, NULL, 0, ZBLOCK_METRICS_INTERVAL, -1);
 
 	// find the next tueday and start the timer for the tuesday event
 	if (zblock_config.tuesday_enable) {
@@ -697,7 +957,17 @@ int main(void) {
 
 	discord_run(client);
 	
-	PQfinish(database_conn);
+	zblock_poller_stop();
+	// the poller may have left posts behind, and may have been waiting on the outbox to make room for them
+	zblock_outbox_stop();
+	// fetches still running are called back with an error, which the workers still need to be around for
+	zblock_feed_fetch_stop();
+	zblock_db_worker_stop();
+	zblock_db_pool_destroy();
+	zblock_list_cache_clear();
+	zblock_arena_pool_destroy();
+	// one last time so the final cycle isn't lost
+	if (zblock_config.metrics_file) timer_write_metrics(client, NULL);
 	cleanup:
 	discord_cleanup(client);
 	ccord_global_cleanup();
@@ -0,0 +1,174 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <concord/discord.h>
+#include <concord/log.h>
+
+#include "message_batch.h"
+#include "outbox.h"
+
+#define CHANNEL_BUCKETS 256
+
+typedef struct batch_channel {
+	u64snowflake channel_id;
+	char *feed_url; // feed the last heading was for
+	char *feed_title;
+	int nitems; // items from the current feed
+	int nskipped; // items from the current feed past ZBLOCK_MESSAGE_BATCH_MAX_ITEMS
+	bool heading_sent; // the current feed's heading is in msg
+	size_t len;
+	char msg[ZBLOCK_MESSAGE_BATCH_MAX_LEN + 1];
+	struct batch_channel *hash_next;
+	struct batch_channel *next; // every channel in the batch, in the order they were added
+} batch_channel;
+
+struct zblock_message_batch {
+	batch_channel *buckets[CHANNEL_BUCKETS];
+	batch_channel *head, *tail;
+};
+
+static unsigned hash_channel(u64snowflake channel_id) {
+	// snowflakes are mostly timestamp in the high bits
+	return (channel_id ^ (channel_id >> 22)) % CHANNEL_BUCKETS;
+}
+
+// creates an empty batch. returns NULL if out of memory.
+zblock_message_batch *zblock_message_batch_new(void) {
+	return calloc(1, sizeof(zblock_message_batch));
+}
+
+static void channel_free(batch_channel *channel) {
+	free(channel->feed_url);
+	free(channel->feed_title);
+	free(channel);
+}
+
+// frees the batch without sending what's left in it
+void zblock_message_batch_delete(zblock_message_batch *batch) {
+	if (!batch) return;
+	batch_channel *channel = batch->head;
+	while (channel) {
+		batch_channel *next = channel->next;
+		channel_free(channel);
+		channel = next;
+	}
+	free(batch);
+}
+
+static batch_channel *batch_get_channel(zblock_message_batch *batch, u64snowflake channel_id) {
+	batch_channel **bucket = &batch->buckets[hash_channel(channel_id)];
+	for (batch_channel *channel = *bucket; channel; channel = channel->hash_next) {
+		if (channel->channel_id == channel_id) return channel;
+	}
+
+	batch_channel *channel = malloc(sizeof(*channel));
+	if (!channel) return NULL;
+	*channel = (batch_channel) {
+		.channel_id = channel_id,
+		.hash_next = *bucket
+	};
+	*bucket = channel;
+	if (batch->tail) batch->tail->next = channel;
+	else batch->head = channel;
+	batch->tail = channel;
+	return channel;
+}
+
+// hands the channel's message to the outbox and starts a new one
+static void channel_send(batch_channel *channel) {
+	if (!channel->len) return;
+	zblock_outbox_err err = zblock_outbox_send(channel->channel_id, channel->msg);
+	if (err) log_error("Unable to queue a message for channel %" PRIu64 ": %s", channel->channel_id, zblock_outbox_strerror(err));
+	channel->len = 0;
+	channel->msg[0] = 0;
+	channel->heading_sent = false;
+}
+
+// writes to the end of the channel's message, cutting it off if it's too long
+static void channel_write(batch_channel *channel, const char *str) {
+	size_t room = ZBLOCK_MESSAGE_BATCH_MAX_LEN - channel->len;
+	size_t len = strnlen(str, room);
+	memcpy(channel->msg + channel->len, str, len);
+	channel->len += len;
+	channel->msg[channel->len] = 0;
+}
+
+/* Appends a line under the current feed's heading, sending the message first if they don't fit.
+ * The heading is repeated at the top of every message the feed's lines end up in. */
+static void channel_append(batch_channel *channel, const char *line) {
+	size_t heading_len = strlen("### \n") + strlen(channel->feed_title);
+	size_t needed = strlen(line) + (channel->heading_sent ? 0 : heading_len);
+	if (channel->len + needed > ZBLOCK_MESSAGE_BATCH_MAX_LEN) channel_send(channel);
+
+	if (!channel->heading_sent) {
+		channel_write(channel, "### ");
+		channel_write(channel, channel->feed_title);
+		channel_write(channel, "\n");
+		channel->heading_sent = true;
+	}
+	channel_write(channel, line);
+}
+
+// finishes the current feed of a channel with a line about how many items were left out
+static void channel_end_feed(batch_channel *channel) {
+	if (channel->nskipped) {
+		char line[64];
+		snprintf(line, sizeof(line), "*...and %d older item%s*\n", channel->nskipped, channel->nskipped == 1 ? "" : "s");
+		channel_append(channel, line);
+	}
+	channel->nitems = 0;
+	channel->nskipped = 0;
+	channel->heading_sent = false;
+}
+
+/* Adds an item to a channel's messages. Every item from the same feed has to be added in a row, newest first.
+ * Returns false if out of memory. */
+bool zblock_message_batch_add(zblock_message_batch *batch, u64snowflake channel_id, const char *feed_url, const char *feed_title, const char *title, const char *link) {
+	batch_channel *channel = batch_get_channel(batch, channel_id);
+	if (!channel) return false;
+
+	if (!channel->feed_url || strcmp(channel->feed_url, feed_url)) {
+		char *new_url = strdup(feed_url);
+		char *new_title = strdup(feed_title);
+		if (!new_url || !new_title) {
+			free(new_url);
+			free(new_title);
+			return false;
+		}
+		channel_end_feed(channel);
+		free(channel->feed_url);
+		free(channel->feed_title);
+		channel->feed_url = new_url;
+		channel->feed_title = new_title;
+	}
+
+	// catching up after downtime shouldn't bury the channel
+	if (channel->nitems == ZBLOCK_MESSAGE_BATCH_MAX_ITEMS) {
+		++channel->nskipped;
+		return true;
+	}
+	++channel->nitems;
+
+	char line[ZBLOCK_MESSAGE_BATCH_MAX_LEN + 1];
+	snprintf(line, sizeof(line), "[%s](%s)\n", title, link);
+	channel_append(channel, line);
+	return true;
+}
+
+// queues everything that is still waiting on the outbox and empties the batch
+void zblock_message_batch_send(zblock_message_batch *batch) {
+	batch_channel *channel = batch->head;
+	while (channel) {
+		batch_channel *next = channel->next;
+		channel_end_feed(channel);
+		channel_send(channel);
+		channel_free(channel);
+		channel = next;
+	}
+	memset(batch->buckets, 0, sizeof(batch->buckets));
+	batch->head = batch->tail = NULL;
+}
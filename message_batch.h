@@ -0,0 +1,32 @@
+#ifndef ZBLOCK_MESSAGE_BATCH_H
+#define ZBLOCK_MESSAGE_BATCH_H
+
+#include <stdbool.h>
+
+#include <concord/discord.h>
+
+/* Discord allows 2000 characters in a message. Packing by bytes keeps every message under that no matter what is in it,
+ * while DISCORD_MAX_MESSAGE_LEN leaves room for multibyte characters. */
+#define ZBLOCK_MESSAGE_BATCH_MAX_LEN 2000
+
+// most items from one feed sent to a channel at once. anything past this is summed up in one line.
+#define ZBLOCK_MESSAGE_BATCH_MAX_ITEMS 10
+
+/* Collects new items for each channel and packs them into as few messages as possible.
+ * Items are grouped under a heading for their feed, and a message is only sent once it's full or the batch is sent. */
+typedef struct zblock_message_batch zblock_message_batch;
+
+// creates an empty batch. returns NULL if out of memory.
+zblock_message_batch *zblock_message_batch_new(void);
+
+// frees the batch without sending what's left in it
+void zblock_message_batch_delete(zblock_message_batch *batch);
+
+/* Adds an item to a channel's messages. Every item from the same feed has to be added in a row, newest first.
+ * Returns false if out of memory. */
+bool zblock_message_batch_add(zblock_message_batch *batch, u64snowflake channel_id, const char *feed_url, const char *feed_title, const char *title, const char *link);
+
+// queues everything that is still waiting on the outbox and empties the batch
+void zblock_message_batch_send(zblock_message_batch *batch);
+
+#endif
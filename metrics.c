@@ -0,0 +1,157 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "metrics.h"
+
+static const char *ZBLOCK_METRICS_ERRORS[] = {
+	"OK",
+	"Unable to write the metrics file"
+};
+static_assert(sizeof(ZBLOCK_METRICS_ERRORS) / sizeof(*ZBLOCK_METRICS_ERRORS) == ZBLOCK_METRICS_ERRORCOUNT, "Not all metrics errors implemented");
+
+// a counter or histogram as it is exported. counters with the same name are one family told apart by their label.
+struct metric_desc {
+	const char *name;
+	const char *help;
+	const char *label; // NULL if the family has no labels
+};
+
+static const struct metric_desc COUNTERS[] = {
+	[ZBLOCK_METRIC_HTTP_2XX] = { "zblock_feed_http_responses_total", "Feed responses by status class.", "class=\"2xx\"" },
+	[ZBLOCK_METRIC_HTTP_3XX] = { "zblock_feed_http_responses_total", "Feed responses by status class.", "class=\"3xx\"" },
+	[ZBLOCK_METRIC_HTTP_4XX] = { "zblock_feed_http_responses_total", "Feed responses by status class.", "class=\"4xx\"" },
+	[ZBLOCK_METRIC_HTTP_5XX] = { "zblock_feed_http_responses_total", "Feed responses by status class.", "class=\"5xx\"" },
+	[ZBLOCK_METRIC_HTTP_OTHER] = { "zblock_feed_http_responses_total", "Feed responses by status class.", "class=\"other\"" },
+	[ZBLOCK_METRIC_FETCH_ERRORS] = { "zblock_feed_fetch_errors_total", "Feed downloads that failed without a response.", NULL },
+	[ZBLOCK_METRIC_BYTES_DOWNLOADED] = { "zblock_feed_downloaded_bytes_total", "Bytes of feed bodies downloaded.", NULL },
+	[ZBLOCK_METRIC_ITEMS_POSTED] = { "zblock_feed_items_posted_total", "New items queued to be posted, counted once per channel.", NULL }
+};
+static_assert(sizeof(COUNTERS) / sizeof(*COUNTERS) == ZBLOCK_METRIC_COUNTERCOUNT, "Not all counters described");
+
+static const struct metric_desc HISTOGRAMS[] = {
+	[ZBLOCK_METRIC_CYCLE_DURATION] = { "zblock_poller_cycle_duration_seconds", "Time taken by a whole poller cycle.", NULL },
+	[ZBLOCK_METRIC_FETCH_DURATION] = { "zblock_feed_fetch_duration_seconds", "Time taken by one feed download.", NULL },
+	[ZBLOCK_METRIC_PARSE_DURATION] = { "zblock_feed_parse_duration_seconds", "Time spent parsing one feed.", NULL },
+	[ZBLOCK_METRIC_DB_QUERY_DURATION] = { "zblock_db_query_duration_seconds", "Time taken by one feed info statement.", NULL },
+	[ZBLOCK_METRIC_DB_BATCH_DURATION] = { "zblock_db_batch_duration_seconds", "Time taken to flush one batch of feed updates.", NULL },
+	[ZBLOCK_METRIC_INTERACTION_DISPATCH] = { "zblock_interaction_dispatch_duration_seconds", "Time an interaction holds up the gateway thread.", NULL },
+	[ZBLOCK_METRIC_INTERACTION_DURATION] = { "zblock_interaction_duration_seconds", "Time from queueing an interaction to answering it.", NULL }
+};
+static_assert(sizeof(HISTOGRAMS) / sizeof(*HISTOGRAMS) == ZBLOCK_METRIC_HISTOGRAMCOUNT, "Not all histograms described");
+
+// upper bounds of the histogram buckets (in microseconds), from a quick query up to a slow cycle. there is one more bucket for everything past the last.
+static const uint64_t BUCKET_BOUNDS[] = {
+	1000, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000, 30000000, 60000000
+};
+#define NBUCKETS (sizeof(BUCKET_BOUNDS) / sizeof(*BUCKET_BOUNDS) + 1)
+
+// everything is only ever added to, so relaxed atomics are all it takes. a scrape can land between a bucket and the sum being updated, which prometheus is fine with.
+static _Atomic uint64_t counters[ZBLOCK_METRIC_COUNTERCOUNT];
+static struct {
+	_Atomic uint64_t buckets[NBUCKETS]; // not cumulative, that's done when writing
+	_Atomic uint64_t sum; // in microseconds
+} histograms[ZBLOCK_METRIC_HISTOGRAMCOUNT];
+
+// returns a monotonic timestamp in microseconds to time things with
+uint64_t zblock_metrics_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// adds n to a counter. safe from any thread, nothing is locked.
+void zblock_metrics_add(zblock_metric_counter counter, uint64_t n) {
+	atomic_fetch_add_explicit(&counters[counter], n, memory_order_relaxed);
+}
+
+// counts a feed response by the class of its status code
+void zblock_metrics_http_status(long status) {
+	zblock_metric_counter counter = status >= 200 && status < 600 ? ZBLOCK_METRIC_HTTP_2XX + (status / 100 - 2) : ZBLOCK_METRIC_HTTP_OTHER;
+	zblock_metrics_add(counter, 1);
+}
+
+// records how long something took (in microseconds). safe from any thread, nothing is locked.
+void zblock_metrics_observe(zblock_metric_histogram histogram, uint64_t usec) {
+	size_t bucket = 0;
+	while (bucket < NBUCKETS - 1 && usec > BUCKET_BOUNDS[bucket]) ++bucket;
+	atomic_fetch_add_explicit(&histograms[histogram].buckets[bucket], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&histograms[histogram].sum, usec, memory_order_relaxed);
+}
+
+// records the time since start, which came from zblock_metrics_now
+void zblock_metrics_observe_since(zblock_metric_histogram histogram, uint64_t start) {
+	zblock_metrics_observe(histogram, zblock_metrics_now() - start);
+}
+
+// returns how many times a histogram has been observed
+uint64_t zblock_metrics_count(zblock_metric_histogram histogram) {
+	uint64_t count = 0;
+	for (size_t i = 0; i < NBUCKETS; ++i) count += atomic_load_explicit(&histograms[histogram].buckets[i], memory_order_relaxed);
+	return count;
+}
+
+// writes HELP and TYPE, unless the last metric was from the same family
+static void write_header(FILE *file, const struct metric_desc *desc, const struct metric_desc *prev, const char *type) {
+	if (prev && !strcmp(prev->name, desc->name)) return;
+	fprintf(file, "# HELP %s %s\n# TYPE %s %s\n", desc->name, desc->help, desc->name, type);
+}
+
+static void write_seconds(FILE *file, uint64_t usec) {
+	fprintf(file, "%" PRIu64 ".%06" PRIu64, usec / 1000000, usec % 1000000);
+}
+
+/* Writes every metric to path in the Prometheus text format.
+ * The file is written next to path and renamed over it, so a scraper never sees half of it. */
+zblock_metrics_err zblock_metrics_write(const char *path) {
+	size_t tmp_size = strlen(path) + sizeof(".tmp");
+	char *tmp_path = malloc(tmp_size);
+	if (!tmp_path) return ZBLOCK_METRICS_FILE_ERROR;
+	snprintf(tmp_path, tmp_size, "%s.tmp", path);
+
+	FILE *file = fopen(tmp_path, "w");
+	if (!file) {
+		free(tmp_path);
+		return ZBLOCK_METRICS_FILE_ERROR;
+	}
+
+	for (int i = 0; i < ZBLOCK_METRIC_COUNTERCOUNT; ++i) {
+		const struct metric_desc *desc = &COUNTERS[i];
+		write_header(file, desc, i ? &COUNTERS[i - 1] : NULL, "counter");
+		uint64_t value = atomic_load_explicit(&counters[i], memory_order_relaxed);
+		if (desc->label) fprintf(file, "%s{%s} %" PRIu64 "\n", desc->name, desc->label, value);
+		else fprintf(file, "%s %" PRIu64 "\n", desc->name, value);
+	}
+
+	for (int i = 0; i < ZBLOCK_METRIC_HISTOGRAMCOUNT; ++i) {
+		const struct metric_desc *desc = &HISTOGRAMS[i];
+		write_header(file, desc, i ? &HISTOGRAMS[i - 1] : NULL, "histogram");
+		uint64_t cumulative = 0;
+		for (size_t j = 0; j < NBUCKETS; ++j) {
+			cumulative += atomic_load_explicit(&histograms[i].buckets[j], memory_order_relaxed);
+			if (j < NBUCKETS - 1) fprintf(file, "%s_bucket{le=\"%g\"} %" PRIu64 "\n", desc->name, BUCKET_BOUNDS[j] / 1e6, cumulative);
+			else fprintf(file, "%s_bucket{le=\"+Inf\"} %" PRIu64 "\n", desc->name, cumulative);
+		}
+		fprintf(file, "%s_sum ", desc->name);
+		write_seconds(file, atomic_load_explicit(&histograms[i].sum, memory_order_relaxed));
+		// the count is the +Inf bucket so the two always agree
+		fprintf(file, "\n%s_count %" PRIu64 "\n", desc->name, cumulative);
+	}
+
+	bool ok = !ferror(file);
+	if (fclose(file)) ok = false;
+	if (ok && rename(tmp_path, path)) ok = false;
+	if (!ok) remove(tmp_path);
+	free(tmp_path);
+	return ok ? ZBLOCK_METRICS_OK : ZBLOCK_METRICS_FILE_ERROR;
+}
+
+// returns a string about the result of a metrics function
+const char *zblock_metrics_strerror(zblock_metrics_err error) {
+	return error < 0 || error >= ZBLOCK_METRICS_ERRORCOUNT ? "Unspecified error" : ZBLOCK_METRICS_ERRORS[error];
+}
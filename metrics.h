@@ -0,0 +1,63 @@
+#ifndef ZBLOCK_METRICS_H
+#define ZBLOCK_METRICS_H
+
+#include <stdint.h>
+
+// how often the metrics file is rewritten (in milliseconds)
+#define ZBLOCK_METRICS_INTERVAL 15000
+
+typedef enum {
+	ZBLOCK_METRIC_HTTP_2XX, // feed responses by status class
+	ZBLOCK_METRIC_HTTP_3XX,
+	ZBLOCK_METRIC_HTTP_4XX,
+	ZBLOCK_METRIC_HTTP_5XX,
+	ZBLOCK_METRIC_HTTP_OTHER,
+	ZBLOCK_METRIC_FETCH_ERRORS, // downloads that failed before getting a response
+	ZBLOCK_METRIC_BYTES_DOWNLOADED,
+	ZBLOCK_METRIC_ITEMS_POSTED, // new items queued for a channel, once for every channel
+	ZBLOCK_METRIC_COUNTERCOUNT
+} zblock_metric_counter;
+
+typedef enum {
+	ZBLOCK_METRIC_CYCLE_DURATION, // a whole poller cycle
+	ZBLOCK_METRIC_FETCH_DURATION, // one feed download
+	ZBLOCK_METRIC_PARSE_DURATION, // time spent parsing one feed
+	ZBLOCK_METRIC_DB_QUERY_DURATION, // one feed_info statement
+	ZBLOCK_METRIC_DB_BATCH_DURATION, // one flush of an update batch
+	ZBLOCK_METRIC_INTERACTION_DISPATCH, // time an interaction holds up the gateway
+	ZBLOCK_METRIC_INTERACTION_DURATION, // an interaction job from being queued to being answered
+	ZBLOCK_METRIC_HISTOGRAMCOUNT
+} zblock_metric_histogram;
+
+typedef enum {
+	ZBLOCK_METRICS_OK,
+	ZBLOCK_METRICS_FILE_ERROR,
+	ZBLOCK_METRICS_ERRORCOUNT
+} zblock_metrics_err;
+
+// returns a monotonic timestamp in microseconds to time things with
+uint64_t zblock_metrics_now(void);
+
+// adds n to a counter. safe from any thread, nothing is locked.
+void zblock_metrics_add(zblock_metric_counter counter, uint64_t n);
+
+// counts a feed response by the class of its status code
+void zblock_metrics_http_status(long status);
+
+// records how long something took (in microseconds). safe from any thread, nothing is locked.
+void zblock_metrics_observe(zblock_metric_histogram histogram, uint64_t usec);
+
+// records the time since start, which came from zblock_metrics_now
+void zblock_metrics_observe_since(zblock_metric_histogram histogram, uint64_t start);
+
+// returns how many times a histogram has been observed
+uint64_t zblock_metrics_count(zblock_metric_histogram histogram);
+
+/* Writes every metric to path in the Prometheus text format.
+ * The file is written next to path and renamed over it, so a scraper never sees half of it. */
+zblock_metrics_err zblock_metrics_write(const char *path);
+
+// returns a string about the result of a metrics function
+const char *zblock_metrics_strerror(zblock_metrics_err error);
+
+#endif
@@ -0,0 +1,404 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <concord/discord.h>
+#include <concord/log.h>
+
+#include "outbox.h"
+
+#define CHANNEL_BUCKETS 256
+
+// time between sends once a burst is used up (in milliseconds)
+#define CHANNEL_INTERVAL (ZBLOCK_OUTBOX_CHANNEL_PERIOD / ZBLOCK_OUTBOX_CHANNEL_BURST)
+#define GLOBAL_INTERVAL (1000 / ZBLOCK_OUTBOX_GLOBAL_RATE)
+
+static const char *ZBLOCK_OUTBOX_ERRORS[] = {
+	"OK",
+	"The outbox is already running",
+	"The outbox is not running",
+	"Out of memory",
+	"Unable to create outbox thread"
+};
+static_assert(sizeof(ZBLOCK_OUTBOX_ERRORS) / sizeof(*ZBLOCK_OUTBOX_ERRORS) == ZBLOCK_OUTBOX_ERRORCOUNT, "Not all outbox errors implemented");
+
+struct outbox_post {
+	char *content;
+	struct outbox_post *next;
+};
+
+/* A channel's queued posts and rate limit. The limit is kept as the time its bucket will be full again:
+ * a post can go out as long as that's less than a burst's worth of sends away. */
+struct outbox_channel {
+	u64snowflake channel_id;
+	uint64_t full_at;
+	struct outbox_post *head, *tail; // oldest first
+	struct outbox_channel *hash_next;
+	struct outbox_channel *next; // the order channels take turns in
+};
+
+// a post concord hasn't called back about yet. its address is handed to concord, so the slots never move.
+struct in_flight {
+	u64snowflake channel_id;
+	uint64_t sent_at;
+	bool used;
+};
+
+// a post taken off the queue to be sent once the lock is let go
+struct ready_post {
+	u64snowflake channel_id;
+	char *content;
+	struct in_flight *slot;
+};
+
+static struct {
+	struct discord *client;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond; // new posts and finished sends wake up the thread
+	pthread_cond_t space; // senders wait for room in the queue
+	struct outbox_channel *buckets[CHANNEL_BUCKETS];
+	struct outbox_channel *head, *tail; // channels with posts waiting or a bucket that isn't full yet, next turn first
+	int nchannels;
+	int nqueued;
+	uint64_t global_full_at; // same as a channel's, for every post together
+	struct in_flight in_flight[ZBLOCK_OUTBOX_MAX_IN_FLIGHT];
+	int nin_flight;
+	bool running;
+	bool stop;
+} outbox = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.space = PTHREAD_COND_INITIALIZER
+};
+
+static uint64_t now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static unsigned hash_channel(u64snowflake channel_id) {
+	// snowflakes are mostly timestamp in the high bits
+	return (channel_id ^ (channel_id >> 22)) % CHANNEL_BUCKETS;
+}
+
+// the lock must be held
+static struct outbox_channel *channel_find(u64snowflake channel_id) {
+	struct outbox_channel *channel = outbox.buckets[hash_channel(channel_id)];
+	while (channel && channel->channel_id != channel_id) channel = channel->hash_next;
+	return channel;
+}
+
+// earliest time a bucket lets another post out
+static uint64_t bucket_ready_at(uint64_t full_at, uint64_t period, uint64_t interval) {
+	uint64_t burst = period - interval;
+	return full_at > burst ? full_at - burst : 0;
+}
+
+// takes a post out of a bucket
+static void bucket_take(uint64_t *full_at, uint64_t now, uint64_t interval) {
+	*full_at = (*full_at > now ? *full_at : now) + interval;
+}
+
+// takes a channel out of its hash bucket and frees it. the caller unlinks it from the turn order. the lock must be held.
+static void channel_free(struct outbox_channel *channel) {
+	struct outbox_channel **link = &outbox.buckets[hash_channel(channel->channel_id)];
+	while (*link != channel) link = &(*link)->hash_next;
+	*link = channel->hash_next;
+
+	struct outbox_post *post = channel->head;
+	while (post) {
+		struct outbox_post *next = post->next;
+		free(post->content);
+		free(post);
+		post = next;
+	}
+	free(channel);
+	--outbox.nchannels;
+}
+
+// gives a slot back. it's fine if it was already given back. the lock must be held.
+static void slot_release(struct in_flight *slot) {
+	if (!slot->used) return;
+	slot->used = false;
+	--outbox.nin_flight;
+	pthread_cond_signal(&outbox.cond);
+}
+
+// the lock must be held
+static struct in_flight *slot_take(u64snowflake channel_id, uint64_t now) {
+	for (int i = 0; i < ZBLOCK_OUTBOX_MAX_IN_FLIGHT; ++i) {
+		struct in_flight *slot = &outbox.in_flight[i];
+		if (slot->used) continue;
+		*slot = (struct in_flight) {
+			.channel_id = channel_id,
+			.sent_at = now,
+			.used = true
+		};
+		++outbox.nin_flight;
+		return slot;
+	}
+	return NULL;
+}
+
+/* Gives up on posts concord never called back about, so a lost callback can't stall the queue.
+ * If the callback does show up later it might give back a newer post's slot early, which only lets one extra post through.
+ * Returns when the next one will time out. The lock must be held. */
+static uint64_t reclaim_in_flight(uint64_t now) {
+	uint64_t next = UINT64_MAX;
+	for (int i = 0; i < ZBLOCK_OUTBOX_MAX_IN_FLIGHT; ++i) {
+		struct in_flight *slot = &outbox.in_flight[i];
+		if (!slot->used) continue;
+		uint64_t timeout = slot->sent_at + ZBLOCK_OUTBOX_SEND_TIMEOUT;
+		if (timeout <= now) {
+			log_warn("No response for a post to channel %" PRIu64 ", giving up on it", slot->channel_id);
+			slot_release(slot);
+		} else if (timeout < next) {
+			next = timeout;
+		}
+	}
+	return next;
+}
+
+static void send_done(struct discord *client, struct discord_response *resp, const struct discord_message *msg) {
+	(void) client;
+	(void) msg;
+
+	pthread_mutex_lock(&outbox.lock);
+	slot_release(resp->data);
+	pthread_mutex_unlock(&outbox.lock);
+}
+
+static void send_fail(struct discord *client, struct discord_response *resp) {
+	(void) client;
+
+	pthread_mutex_lock(&outbox.lock);
+	struct in_flight *slot = resp->data;
+	log_warn("Unable to post to channel %" PRIu64 " (error %d)", slot->channel_id, resp->code);
+	// concord already waited out any 429 it got, so don't retry. slowing the channel to its steady rate keeps it from happening again.
+	struct outbox_channel *channel = channel_find(slot->channel_id);
+	uint64_t empty_at = now_ms() + ZBLOCK_OUTBOX_CHANNEL_PERIOD;
+	if (channel && channel->full_at < empty_at) channel->full_at = empty_at;
+	slot_release(slot);
+	pthread_mutex_unlock(&outbox.lock);
+}
+
+/* Takes every post that can go out right now, giving each channel one turn, and frees channels that have nothing left to wait for.
+ * Returns how many were put in ready and sets *wake to when another post could go out. The lock must be held. */
+static int take_ready(uint64_t now, struct ready_post *ready, uint64_t *wake) {
+	int nready = 0;
+	int n = outbox.nchannels;
+	struct outbox_channel **link = &outbox.head;
+	struct outbox_channel *prev = NULL;
+	for (int i = 0; i < n; ++i) {
+		struct outbox_channel *channel = *link;
+		uint64_t channel_ready = bucket_ready_at(channel->full_at, ZBLOCK_OUTBOX_CHANNEL_PERIOD, CHANNEL_INTERVAL);
+		uint64_t global_ready = bucket_ready_at(outbox.global_full_at, 1000, GLOBAL_INTERVAL);
+		bool idle = !channel->head && channel->full_at <= now;
+
+		if (channel->head && channel_ready <= now && global_ready <= now && outbox.nin_flight < ZBLOCK_OUTBOX_MAX_IN_FLIGHT) {
+			struct outbox_post *post = channel->head;
+			channel->head = post->next;
+			if (!channel->head) channel->tail = NULL;
+			--outbox.nqueued;
+			bucket_take(&channel->full_at, now, CHANNEL_INTERVAL);
+			bucket_take(&outbox.global_full_at, now, GLOBAL_INTERVAL);
+			ready[nready++] = (struct ready_post) {
+				.channel_id = channel->channel_id,
+				.content = post->content,
+				.slot = slot_take(channel->channel_id, now)
+			};
+			free(post);
+			if (channel->head) {
+				channel_ready = bucket_ready_at(channel->full_at, ZBLOCK_OUTBOX_CHANNEL_PERIOD, CHANNEL_INTERVAL);
+				if (channel_ready < *wake) *wake = channel_ready;
+			}
+
+			// its turn is over, so it goes to the back
+			*link = channel->next;
+			if (outbox.tail == channel) outbox.tail = prev;
+			channel->next = NULL;
+			if (outbox.tail) outbox.tail->next = channel;
+			else outbox.head = channel;
+			outbox.tail = channel;
+			continue;
+		}
+
+		if (idle) {
+			*link = channel->next;
+			if (outbox.tail == channel) outbox.tail = prev;
+			channel_free(channel);
+			continue;
+		}
+
+		if (channel->head) {
+			// whichever limit is holding it back decides when to look again. a full in-flight list is woken up by the callbacks.
+			uint64_t at = channel_ready > global_ready ? channel_ready : global_ready;
+			if (outbox.nin_flight < ZBLOCK_OUTBOX_MAX_IN_FLIGHT && at < *wake) *wake = at;
+		}
+		prev = channel;
+		link = &channel->next;
+	}
+
+	if (nready) pthread_cond_broadcast(&outbox.space);
+	return nready;
+}
+
+static void *thread_outbox(void *arg) {
+	(void) arg;
+
+	uint64_t stop_at = 0;
+	struct ready_post ready[ZBLOCK_OUTBOX_MAX_IN_FLIGHT];
+	pthread_mutex_lock(&outbox.lock);
+	for (;;) {
+		uint64_t now = now_ms();
+		if (outbox.stop) {
+			if (!stop_at) stop_at = now + ZBLOCK_OUTBOX_STOP_TIMEOUT;
+			if (!outbox.nqueued || now >= stop_at) break;
+		}
+
+		uint64_t wake = reclaim_in_flight(now);
+		if (stop_at && stop_at < wake) wake = stop_at;
+		int nready = take_ready(now, ready, &wake);
+
+		if (nready) {
+			// concord can call back before returning, and the callbacks take the lock
+			pthread_mutex_unlock(&outbox.lock);
+			for (int i = 0; i < nready; ++i) {
+				struct discord_create_message params = { .content = ready[i].content };
+				struct discord_ret_message ret = {
+					.done = &send_done,
+					.fail = &send_fail,
+					.data = ready[i].slot
+				};
+				CCORDcode code = discord_create_message(outbox.client, ready[i].channel_id, &params, &ret);
+				free(ready[i].content);
+				if (code) {
+					log_warn("Unable to post to channel %" PRIu64 " (error %d)", ready[i].channel_id, code);
+					pthread_mutex_lock(&outbox.lock);
+					slot_release(ready[i].slot);
+					pthread_mutex_unlock(&outbox.lock);
+				}
+			}
+			pthread_mutex_lock(&outbox.lock);
+			continue;
+		}
+
+		if (wake == UINT64_MAX) {
+			pthread_cond_wait(&outbox.cond, &outbox.lock);
+		} else {
+			struct timespec ts = {
+				.tv_sec = wake / 1000,
+				.tv_nsec = wake % 1000 * 1000000
+			};
+			pthread_cond_timedwait(&outbox.cond, &outbox.lock, &ts);
+		}
+	}
+
+	if (outbox.nqueued) log_warn("Dropping %d posts that weren't sent before shutting down", outbox.nqueued);
+	while (outbox.head) {
+		struct outbox_channel *channel = outbox.head;
+		outbox.head = channel->next;
+		channel_free(channel);
+	}
+	outbox.tail = NULL;
+	outbox.nqueued = 0;
+	pthread_mutex_unlock(&outbox.lock);
+
+	return NULL;
+}
+
+// starts the thread that posts queued messages with client, keeping each channel and the bot as a whole under the rate limits
+zblock_outbox_err zblock_outbox_start(struct discord *client) {
+	if (outbox.running) return ZBLOCK_OUTBOX_RUNNING;
+
+	// waits are timed against the same clock as the rate limits
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_destroy(&outbox.cond);
+	pthread_cond_init(&outbox.cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	outbox.client = client;
+	outbox.stop = false;
+	if (pthread_create(&outbox.thread, NULL, &thread_outbox, NULL)) return ZBLOCK_OUTBOX_THREAD_ERROR;
+
+	outbox.running = true;
+	return ZBLOCK_OUTBOX_OK;
+}
+
+/* Queues a message to be posted to a channel. Messages to the same channel are posted in the order they were queued.
+ * The content is copied. Blocks while the queue is full, so whoever is filling it can't get ahead of Discord. */
+zblock_outbox_err zblock_outbox_send(u64snowflake channel_id, const char *content) {
+	struct outbox_post *post = malloc(sizeof(*post));
+	if (!post) return ZBLOCK_OUTBOX_NOMEM;
+	*post = (struct outbox_post) { .content = strdup(content) };
+	if (!post->content) {
+		free(post);
+		return ZBLOCK_OUTBOX_NOMEM;
+	}
+
+	pthread_mutex_lock(&outbox.lock);
+	while (outbox.running && !outbox.stop && outbox.nqueued >= ZBLOCK_OUTBOX_MAX_QUEUED) pthread_cond_wait(&outbox.space, &outbox.lock);
+	if (!outbox.running || outbox.stop) {
+		pthread_mutex_unlock(&outbox.lock);
+		free(post->content);
+		free(post);
+		return ZBLOCK_OUTBOX_NOT_RUNNING;
+	}
+
+	struct outbox_channel *channel = channel_find(channel_id);
+	if (!channel) {
+		channel = calloc(1, sizeof(*channel));
+		if (!channel) {
+			pthread_mutex_unlock(&outbox.lock);
+			free(post->content);
+			free(post);
+			return ZBLOCK_OUTBOX_NOMEM;
+		}
+		channel->channel_id = channel_id;
+		struct outbox_channel **bucket = &outbox.buckets[hash_channel(channel_id)];
+		channel->hash_next = *bucket;
+		*bucket = channel;
+		if (outbox.tail) outbox.tail->next = channel;
+		else outbox.head = channel;
+		outbox.tail = channel;
+		++outbox.nchannels;
+	}
+
+	if (channel->tail) channel->tail->next = post;
+	else channel->head = post;
+	channel->tail = post;
+	++outbox.nqueued;
+	pthread_cond_signal(&outbox.cond);
+	pthread_mutex_unlock(&outbox.lock);
+
+	return ZBLOCK_OUTBOX_OK;
+}
+
+// waits a little for the queue to empty, drops anything that's left and stops the thread
+void zblock_outbox_stop(void) {
+	if (!outbox.running) return;
+
+	pthread_mutex_lock(&outbox.lock);
+	outbox.stop = true;
+	pthread_cond_signal(&outbox.cond);
+	// nobody gets to wait for room anymore
+	pthread_cond_broadcast(&outbox.space);
+	pthread_mutex_unlock(&outbox.lock);
+
+	pthread_join(outbox.thread, NULL);
+	outbox.running = false;
+}
+
+// returns a string about the result of an outbox function
+const char *zblock_outbox_strerror(zblock_outbox_err error) {
+	return error < 0 || error >= ZBLOCK_OUTBOX_ERRORCOUNT ? "Unspecified error" : ZBLOCK_OUTBOX_ERRORS[error];
+}
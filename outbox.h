@@ -0,0 +1,49 @@
+#ifndef ZBLOCK_OUTBOX_H
+#define ZBLOCK_OUTBOX_H
+
+#include <concord/discord.h>
+
+/* Discord lets a bot post 5 messages to a channel every 5 seconds.
+ * A channel can send a burst of ZBLOCK_OUTBOX_CHANNEL_BURST and then gets one back every ZBLOCK_OUTBOX_CHANNEL_PERIOD / ZBLOCK_OUTBOX_CHANNEL_BURST. */
+#define ZBLOCK_OUTBOX_CHANNEL_BURST 5
+#define ZBLOCK_OUTBOX_CHANNEL_PERIOD 5000 // in milliseconds
+
+// feed posts sent per second across every channel. the global limit is 50, the rest is left for interactions and everything else.
+#define ZBLOCK_OUTBOX_GLOBAL_RATE 40
+
+/* Most posts handed to concord that haven't finished yet.
+ * Keeping this low means concord's own queue never backs up with feed posts, so interaction responses don't wait behind them. */
+#define ZBLOCK_OUTBOX_MAX_IN_FLIGHT 8
+
+// a post that concord hasn't called back about after this long is given up on (in milliseconds)
+#define ZBLOCK_OUTBOX_SEND_TIMEOUT 30000
+
+// zblock_outbox_send blocks while this many posts are waiting
+#define ZBLOCK_OUTBOX_MAX_QUEUED 500
+
+// how long stopping waits for the queue to empty before dropping what's left (in milliseconds)
+#define ZBLOCK_OUTBOX_STOP_TIMEOUT 10000
+
+typedef enum {
+	ZBLOCK_OUTBOX_OK,
+	ZBLOCK_OUTBOX_RUNNING,
+	ZBLOCK_OUTBOX_NOT_RUNNING,
+	ZBLOCK_OUTBOX_NOMEM,
+	ZBLOCK_OUTBOX_THREAD_ERROR,
+	ZBLOCK_OUTBOX_ERRORCOUNT
+} zblock_outbox_err;
+
+// starts the thread that posts queued messages with client, keeping each channel and the bot as a whole under the rate limits
+zblock_outbox_err zblock_outbox_start(struct discord *client);
+
+/* Queues a message to be posted to a channel. Messages to the same channel are posted in the order they were queued.
+ * The content is copied. Blocks while the queue is full, so whoever is filling it can't get ahead of Discord. */
+zblock_outbox_err zblock_outbox_send(u64snowflake channel_id, const char *content);
+
+// waits a little for the queue to empty, drops anything that's left and stops the thread
+void zblock_outbox_stop(void);
+
+// returns a string about the result of an outbox function
+const char *zblock_outbox_strerror(zblock_outbox_err error);
+
+#endif
@@ -0,0 +1,777 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <curl/curl.h>
+
+#include <concord/discord.h>
+#include <concord/log.h>
+
+#include <libpq-fe.h>
+
+#include "config.h"
+#include "feed_info.h"
+#include "date.h"
+#include "schedule.h"
+#include "feed_parser.h"
+#include "admission.h"
+#include "db_pool.h"
+#include "message_batch.h"
+#include "metrics.h"
+#include "outbox.h"
+#include "trace.h"
+#include "poller.h"
+
+// number of database updates to queue up before sending them
+#define POLLER_BATCH_SIZE 128
+
+static const char *ZBLOCK_POLLER_ERRORS[] = {
+	"OK",
+	"The poller is already running",
+	"Unable to create curl multi handle",
+	"Unable to create poller thread"
+};
+static_assert(sizeof(ZBLOCK_POLLER_ERRORS) / sizeof(*ZBLOCK_POLLER_ERRORS) == ZBLOCK_POLLER_ERRORCOUNT, "Not all poller errors implemented");
+
+// how long cached DNS entries are kept (in seconds), long enough to last between cycles
+#define POLLER_DNS_CACHE_TIMEOUT 900
+
+/* Limits on a single download (in seconds). Every download has to finish before the cycle does,
+ * so without them one server that stops answering holds up every feed after it. */
+#define POLLER_TIMEOUT 60
+#define POLLER_CONNECT_TIMEOUT 10
+// a download slower than this many bytes per second for POLLER_LOW_SPEED_TIME seconds is given up on
+#define POLLER_LOW_SPEED_LIMIT 64
+#define POLLER_LOW_SPEED_TIME 20
+
+/* How much of the start of a body is hashed to tell if it changed since the last poll (in bytes).
+ * New items are at the start of a feed, so this covers them while still letting big feeds stop early.
+ * Most feeds are smaller than this, so their whole body is compared. */
+#define POLLER_HASH_PREFIX_SIZE 65536
+
+// everything owned by the poller thread
+static struct {
+	CURLM *multi; // kept alive so connections, DNS and TLS sessions are reused across cycles
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool running;
+	bool wakeup; // a cycle was requested
+	bool stop;
+} poller = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER
+};
+
+// a new item in a feed along with its parsed publication date
+typedef struct {
+	char *title;
+	char *link;
+	time_t pubDate;
+} zblock_feed_item;
+
+// one download of a feed url, shared by every channel subscribed to it
+typedef struct {
+	zblock_feed_info_minimal *subs; // all subscriptions to this url (subs[0].url is the url being retrieved)
+	size_t nsubs;
+	size_t subs_capacity;
+	char *host; // used to limit connections per host
+	struct curl_slist *headers; // conditional request headers
+	// response status and the cache validators sent with it
+	long status;
+	char *etag;
+	char *last_modified;
+	int max_age; // from Cache-Control
+	// the start of the body is held back from the parser until it's known whether it changed
+	uint64_t known_hash; // hash every subscription agrees on, 0 if they don't
+	char *prefix;
+	size_t prefix_len;
+	uint64_t content_hash; // 0 until the prefix has been hashed
+	bool unchanged;
+	// the feed is parsed as it is downloaded
+	zblock_feed_parser parser;
+	uint64_t parse_usec; // time spent in the parser so far
+	time_t oldest_pubDate; // anything at or before this has been seen by every subscriber
+	bool seen_old; // an item at or before oldest_pubDate was found, so the rest are old too
+	zblock_feed_item *items; // new items, newest first
+	size_t nitems;
+	size_t items_capacity;
+	// dates of the newest items for the scheduler
+	time_t item_dates[ZBLOCK_SCHEDULE_SAMPLE_SIZE];
+	size_t ndates;
+	// only filled in while the cycle is being traced
+	uint32_t track;
+	uint64_t queued_at, started_at;
+	uint64_t date_usec; // time spent parsing dates
+} zblock_feed_buffer;
+
+// a timestamp for the trace, or 0 if the cycle isn't being traced so the clock isn't read for nothing
+static uint64_t trace_now(void) {
+	return zblock_trace_recording() ? zblock_metrics_now() : 0;
+}
+
+static void feed_buffer_free(zblock_feed_buffer *feed_buffer) {
+	for (size_t i = 0; i < feed_buffer->nsubs; ++i) {
+		zblock_feed_info_minimal_free(&feed_buffer->subs[i]);
+	}
+	free(feed_buffer->subs);
+	curl_free(feed_buffer->host);
+	for (size_t i = 0; i < feed_buffer->nitems; ++i) {
+		free(feed_buffer->items[i].title);
+		free(feed_buffer->items[i].link);
+	}
+	free(feed_buffer->items);
+	curl_slist_free_all(feed_buffer->headers);
+	free(feed_buffer->prefix);
+	free(feed_buffer->etag);
+	free(feed_buffer->last_modified);
+	free(feed_buffer);
+}
+
+static bool str_equal_nullable(const char *a, const char *b) {
+	return a == b || (a && b && !strcmp(a, b));
+}
+
+// duplicates the value of a header line if it has the given name
+static char *header_value_dup(const char *line, size_t size, const char *name) {
+	size_t name_len = strlen(name);
+	if (size <= name_len || line[name_len] != ':' || strncasecmp(line, name, name_len)) return NULL;
+	
+	const char *value = line + name_len + 1;
+	const char *end = line + size;
+	while (value < end && (*value == ' ' || *value == '\t')) ++value;
+	while (end > value && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' ' || end[-1] == '\t')) --end;
+	return strndup(value, end - value);
+}
+
+// collects the cache validators and max-age out of the response headers
+static size_t feed_buffer_header_callback(char *buffer, size_t size, size_t nitems, void *userdata) {
+	zblock_feed_buffer *feed_buffer = userdata;
+	size_t line_size = size * nitems;
+	
+	if (line_size > 5 && !strncmp(buffer, "HTTP/", 5)) {
+		// new response (a redirect or a 100 Continue), throw out whatever the last one sent so the validators are from the final one
+		const char *status = memchr(buffer, ' ', line_size);
+		feed_buffer->status = status ? strtol(status + 1, NULL, 10) : 0;
+		free(feed_buffer->etag);
+		free(feed_buffer->last_modified);
+		feed_buffer->etag = NULL;
+		feed_buffer->last_modified = NULL;
+		feed_buffer->max_age = 0;
+	} else {
+		char *value;
+		if ((value = header_value_dup(buffer, line_size, "ETag"))) {
+			free(feed_buffer->etag);
+			feed_buffer->etag = value;
+		} else if ((value = header_value_dup(buffer, line_size, "Last-Modified"))) {
+			free(feed_buffer->last_modified);
+			feed_buffer->last_modified = value;
+		} else if ((value = header_value_dup(buffer, line_size, "Cache-Control"))) {
+			feed_buffer->max_age = zblock_schedule_max_age(value);
+			free(value);
+		}
+	}
+	
+	return line_size;
+}
+
+// adds If-None-Match and If-Modified-Since headers if every subscription agrees on the cache validators
+static void feed_buffer_set_conditional(CURL *feed_handle, zblock_feed_buffer *feed_buffer) {
+	zblock_feed_info_minimal *first = &feed_buffer->subs[0];
+	for (size_t i = 1; i < feed_buffer->nsubs; ++i) {
+		if (!str_equal_nullable(first->etag, feed_buffer->subs[i].etag)
+			|| !str_equal_nullable(first->last_modified, feed_buffer->subs[i].last_modified)) {
+			return;
+		}
+	}
+	
+	char header[1024];
+	if (first->etag) {
+		snprintf(header, sizeof(header), "If-None-Match: %s", first->etag);
+		struct curl_slist *new_headers = curl_slist_append(feed_buffer->headers, header);
+		if (new_headers) feed_buffer->headers = new_headers;
+	}
+	if (first->last_modified) {
+		snprintf(header, sizeof(header), "If-Modified-Since: %s", first->last_modified);
+		struct curl_slist *new_headers = curl_slist_append(feed_buffer->headers, header);
+		if (new_headers) feed_buffer->headers = new_headers;
+	}
+	if (feed_buffer->headers) curl_easy_setopt(feed_handle, CURLOPT_HTTPHEADER, feed_buffer->headers);
+}
+
+// adds a subscription to the buffer. ownership of the feed info is transferred on success.
+static bool feed_buffer_add_sub(zblock_feed_buffer *feed_buffer, zblock_feed_info_minimal *feed_info) {
+	if (feed_buffer->nsubs == feed_buffer->subs_capacity) {
+		size_t new_capacity = feed_buffer->subs_capacity ? feed_buffer->subs_capacity * 2 : 4;
+		zblock_feed_info_minimal *new_subs = realloc(feed_buffer->subs, new_capacity * sizeof(*new_subs));
+		if (!new_subs) return false;
+		feed_buffer->subs = new_subs;
+		feed_buffer->subs_capacity = new_capacity;
+	}
+	feed_buffer->subs[feed_buffer->nsubs++] = *feed_info;
+	return true;
+}
+
+// collects new items as the parser finds them
+static bool feed_buffer_item_callback(void *userdata, const zblock_feed_entry *entry) {
+	zblock_feed_buffer *feed_buffer = userdata;
+	uint64_t date_start = trace_now();
+	time_t pubDate = zblock_date_parse(entry->pubDate);
+	if (date_start) feed_buffer->date_usec += zblock_metrics_now() - date_start;
+	if (feed_buffer->ndates < ZBLOCK_SCHEDULE_SAMPLE_SIZE) feed_buffer->item_dates[feed_buffer->ndates++] = pubDate;
+	
+	if (pubDate <= feed_buffer->oldest_pubDate) feed_buffer->seen_old = true;
+	if (!feed_buffer->seen_old) {
+		if (feed_buffer->nitems == feed_buffer->items_capacity) {
+			size_t new_capacity = feed_buffer->items_capacity ? feed_buffer->items_capacity * 2 : 8;
+			zblock_feed_item *new_items = realloc(feed_buffer->items, new_capacity * sizeof(*new_items));
+			if (!new_items) {
+				log_error("Failure allocating feed buffer: %s", strerror(errno));
+				return false;
+			}
+			feed_buffer->items = new_items;
+			feed_buffer->items_capacity = new_capacity;
+		}
+		
+		zblock_feed_item item = {
+			.title = strdup(entry->title),
+			.link = strdup(entry->link),
+			.pubDate = pubDate
+		};
+		if (!item.title || !item.link) {
+			log_error("Failure allocating feed buffer: %s", strerror(errno));
+			free(item.title);
+			free(item.link);
+			return false;
+		}
+		feed_buffer->items[feed_buffer->nitems++] = item;
+	}
+	
+	// everything past this point has been seen already, only keep going if the scheduler needs more dates
+	return !feed_buffer->seen_old || feed_buffer->ndates < ZBLOCK_SCHEDULE_SAMPLE_SIZE;
+}
+
+// 64-bit FNV-1a, never 0 so 0 can mean there is no hash
+static uint64_t content_hash(const char *data, size_t size) {
+	uint64_t hash = 0xcbf29ce484222325;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= (unsigned char) data[i];
+		hash *= 0x100000001b3;
+	}
+	return hash ? hash : 1;
+}
+
+// hands part of the body to the parser, keeping track of how long it takes
+static zblock_feed_parser_err feed_buffer_parse(zblock_feed_buffer *feed_buffer, const char *data, size_t size) {
+	uint64_t start = zblock_metrics_now();
+	zblock_feed_parser_err parser_err = zblock_feed_parser_parse(&feed_buffer->parser, data, size);
+	uint64_t end = zblock_metrics_now();
+	feed_buffer->parse_usec += end - start;
+	zblock_trace_span("parse", feed_buffer->track, start, end);
+	return parser_err;
+}
+
+// hashes the held back start of the body and hands it to the parser if it changed. returns false if there's no reason to keep downloading.
+static bool feed_buffer_finish_prefix(zblock_feed_buffer *feed_buffer) {
+	feed_buffer->content_hash = content_hash(feed_buffer->prefix, feed_buffer->prefix_len);
+	if (feed_buffer->content_hash == feed_buffer->known_hash) {
+		feed_buffer->unchanged = true;
+		return false;
+	}
+	
+	zblock_feed_parser_err parser_err = feed_buffer->prefix_len ? feed_buffer_parse(feed_buffer, feed_buffer->prefix, feed_buffer->prefix_len) : ZBLOCK_FEED_PARSER_OK;
+	free(feed_buffer->prefix);
+	feed_buffer->prefix = NULL;
+	return parser_err != ZBLOCK_FEED_PARSER_STOPPED;
+}
+
+// parses the body as it arrives, stopping the transfer once there is nothing new left in it
+static size_t feed_buffer_write_callback(char *data, size_t size, size_t nmemb, void *userdata) {
+	zblock_feed_buffer *feed_buffer = userdata;
+	size_t data_size = size * nmemb;
+	
+	// error pages aren't feeds
+	if (feed_buffer->status >= 300) return data_size;
+	
+	size_t parse_from = 0;
+	if (!feed_buffer->content_hash) {
+		if (!feed_buffer->prefix) {
+			feed_buffer->prefix = malloc(POLLER_HASH_PREFIX_SIZE);
+			if (!feed_buffer->prefix) {
+				log_error("Failure allocating feed buffer: %s", strerror(errno));
+				return 0;
+			}
+		}
+		size_t room = POLLER_HASH_PREFIX_SIZE - feed_buffer->prefix_len;
+		parse_from = data_size < room ? data_size : room;
+		memcpy(feed_buffer->prefix + feed_buffer->prefix_len, data, parse_from);
+		feed_buffer->prefix_len += parse_from;
+		
+		if (feed_buffer->prefix_len < POLLER_HASH_PREFIX_SIZE) return data_size;
+		if (!feed_buffer_finish_prefix(feed_buffer)) return 0;
+	}
+	
+	if (parse_from < data_size && feed_buffer_parse(feed_buffer, data + parse_from, data_size - parse_from) == ZBLOCK_FEED_PARSER_STOPPED) return 0;
+	return data_size;
+}
+
+// starts the download of a feed. returns false on failure.
+static bool feed_buffer_start(CURLM *multi, zblock_feed_buffer *feed_buffer) {
+	feed_buffer->started_at = trace_now();
+	// the oldest watermark decides how far into the feed we need to look
+	feed_buffer->oldest_pubDate = feed_buffer->subs[0].last_pubDate;
+	for (size_t i = 1; i < feed_buffer->nsubs; ++i) {
+		if (feed_buffer->subs[i].last_pubDate < feed_buffer->oldest_pubDate) feed_buffer->oldest_pubDate = feed_buffer->subs[i].last_pubDate;
+	}
+	zblock_feed_parser_init(&feed_buffer->parser, &feed_buffer_item_callback, feed_buffer);
+	// same as the conditional headers, a hash is only trusted if every subscription has it
+	feed_buffer->known_hash = feed_buffer->subs[0].content_hash;
+	for (size_t i = 1; i < feed_buffer->nsubs; ++i) {
+		if (feed_buffer->subs[i].content_hash != feed_buffer->known_hash) feed_buffer->known_hash = 0;
+	}
+
+	CURL *feed_handle = curl_easy_init();
+	if (!feed_handle) return false;
+	
+	curl_easy_setopt(feed_handle, CURLOPT_URL, feed_buffer->subs[0].url);
+	curl_easy_setopt(feed_handle, CURLOPT_WRITEFUNCTION, &feed_buffer_write_callback);
+	curl_easy_setopt(feed_handle, CURLOPT_WRITEDATA, feed_buffer);
+	curl_easy_setopt(feed_handle, CURLOPT_PRIVATE, feed_buffer);
+	curl_easy_setopt(feed_handle, CURLOPT_HEADERFUNCTION, &feed_buffer_header_callback);
+	curl_easy_setopt(feed_handle, CURLOPT_HEADERDATA, feed_buffer);
+	curl_easy_setopt(feed_handle, CURLOPT_DNS_CACHE_TIMEOUT, (long) POLLER_DNS_CACHE_TIMEOUT);
+	// a download that runs out of time fails like any other and the feed is tried again on its schedule
+	curl_easy_setopt(feed_handle, CURLOPT_TIMEOUT, (long) POLLER_TIMEOUT);
+	curl_easy_setopt(feed_handle, CURLOPT_CONNECTTIMEOUT, (long) POLLER_CONNECT_TIMEOUT);
+	curl_easy_setopt(feed_handle, CURLOPT_LOW_SPEED_LIMIT, (long) POLLER_LOW_SPEED_LIMIT);
+	curl_easy_setopt(feed_handle, CURLOPT_LOW_SPEED_TIME, (long) POLLER_LOW_SPEED_TIME);
+	curl_easy_setopt(feed_handle, CURLOPT_USERAGENT, ZBLOCK_CONFIG_USER_AGENT);
+	// feeds move (http to https, new paths) and /add accepts them as long as the redirect works
+	curl_easy_setopt(feed_handle, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(feed_handle, CURLOPT_MAXREDIRS, (long) ZBLOCK_CONFIG_MAX_REDIRECTS);
+	curl_easy_setopt(feed_handle, CURLOPT_REDIR_PROTOCOLS_STR, "http,https");
+	feed_buffer_set_conditional(feed_handle, feed_buffer);
+	CURLMcode mc = curl_multi_add_handle(multi, feed_handle);
+	if (mc) {
+		log_error("Unable to retrieve feed: %s", curl_multi_strerror(mc));
+		curl_easy_cleanup(feed_handle);
+		return false;
+	}
+	
+	int running_handles;
+	curl_multi_perform(multi, &running_handles);
+	return true;
+}
+
+// queues the download of a feed until its host has room for it. the buffer is freed on failure.
+static void feed_buffer_queue(zblock_admission *admission, zblock_feed_buffer *feed_buffer) {
+	CURLU *url = curl_url();
+	if (url && !curl_url_set(url, CURLUPART_URL, feed_buffer->subs[0].url, 0)) {
+		curl_url_get(url, CURLUPART_HOST, &feed_buffer->host, 0);
+	}
+	curl_url_cleanup(url);
+	
+	feed_buffer->queued_at = trace_now();
+	if (!zblock_admission_push(admission, feed_buffer->host, feed_buffer)) {
+		log_error("Failure allocating feed buffer: %s", strerror(errno));
+		feed_buffer_free(feed_buffer);
+	}
+}
+
+// records how a finished download went. curl already timed it and counted the bytes.
+static void feed_buffer_count(CURL *handle, CURLcode result, long response_code) {
+	if (result && !response_code) zblock_metrics_add(ZBLOCK_METRIC_FETCH_ERRORS, 1);
+	else zblock_metrics_http_status(response_code);
+	
+	curl_off_t total_time = 0, size_download = 0;
+	curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &total_time);
+	curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &size_download);
+	zblock_metrics_observe(ZBLOCK_METRIC_FETCH_DURATION, total_time);
+	zblock_metrics_add(ZBLOCK_METRIC_BYTES_DOWNLOADED, size_download);
+}
+
+// curl's timings of each step of a transfer, from when it started (in microseconds)
+static const struct {
+	const char *name;
+	CURLINFO info;
+} TRANSFER_PHASES[] = {
+	{ "dns", CURLINFO_NAMELOOKUP_TIME_T },
+	{ "connect", CURLINFO_CONNECT_TIME_T },
+	{ "tls", CURLINFO_APPCONNECT_TIME_T },
+	{ "request", CURLINFO_STARTTRANSFER_TIME_T },
+	{ "transfer", CURLINFO_TOTAL_TIME_T }
+};
+
+// records the spans of a finished feed on its track
+static void feed_buffer_trace(CURL *handle, zblock_feed_buffer *feed_buffer, long response_code, const char *outcome, uint64_t done_at) {
+	uint32_t track = feed_buffer->track;
+	zblock_trace_span("queued", track, feed_buffer->queued_at, feed_buffer->started_at);
+	
+	// each phase runs from where the last one ended. a reused connection skips dns, connect and tls, so those come out empty.
+	curl_off_t phase_start = 0;
+	for (size_t i = 0; i < sizeof(TRANSFER_PHASES) / sizeof(*TRANSFER_PHASES); ++i) {
+		curl_off_t phase_end = 0;
+		curl_easy_getinfo(handle, TRANSFER_PHASES[i].info, &phase_end);
+		if (phase_end <= phase_start) continue;
+		zblock_trace_span(TRANSFER_PHASES[i].name, track, feed_buffer->started_at + phase_start, feed_buffer->started_at + phase_end);
+		phase_start = phase_end;
+	}
+	
+	uint64_t end = zblock_metrics_now();
+	zblock_trace_span("process", track, done_at, end);
+	
+	char args[256];
+	snprintf(args, sizeof(args), "{\"status\":%ld,\"outcome\":\"%s\",\"subscriptions\":%zu,\"new_items\":%zu,\"parse_us\":%" PRIu64 ",\"date_parse_us\":%" PRIu64 "}",
+		response_code, outcome, feed_buffer->nsubs, feed_buffer->nitems, feed_buffer->parse_usec, feed_buffer->date_usec);
+	zblock_trace_feed(track, feed_buffer->subs[0].url, feed_buffer->queued_at, end, args);
+}
+
+// starts as many queued downloads as the connection limits allow. returns how many were started.
+static int admit_feeds(zblock_admission *admission, CURLM *multi) {
+	int started = 0;
+	zblock_feed_buffer *feed_buffer;
+	while ((feed_buffer = zblock_admission_next(admission))) {
+		if (feed_buffer_start(multi, feed_buffer)) {
+			++started;
+		} else {
+			zblock_admission_done(admission, feed_buffer->host);
+			feed_buffer_free(feed_buffer);
+		}
+	}
+	return started;
+}
+
+// queues all new items in a parsed feed for every channel subscribed to it
+static void feed_buffer_send(zblock_message_batch *messages, zblock_feed_info_batch *batch, zblock_feed_buffer *feed_buffer) {
+	if (!feed_buffer->nitems) return;
+	
+	// some feeds put their title after the items, or don't have one at all
+	const char *feed_title = *feed_buffer->parser.title ? feed_buffer->parser.title : feed_buffer->subs[0].url;
+	zblock_feed_item *items = feed_buffer->items;
+	for (size_t i = 0; i < feed_buffer->nsubs; ++i) {
+		zblock_feed_info_minimal *sub = &feed_buffer->subs[i];
+		size_t j;
+		for (j = 0; j < feed_buffer->nitems && items[j].pubDate > sub->last_pubDate; ++j) {
+			// packed in with the channel's other new items, or sent on its own if that can't be done
+			if (messages && zblock_message_batch_add(messages, sub->channel_id, sub->url, feed_title, items[j].title, items[j].link)) continue;
+			char msg[DISCORD_MAX_MESSAGE_LEN];
+			snprintf(msg, sizeof(msg), "### %s\n[%s](%s)", feed_title, items[j].title, items[j].link);
+			zblock_outbox_err err = zblock_outbox_send(sub->channel_id, msg);
+			if (err) log_error("Unable to queue a message for channel %" PRIu64 ": %s", sub->channel_id, zblock_outbox_strerror(err));
+		}
+		
+		zblock_metrics_add(ZBLOCK_METRIC_ITEMS_POSTED, j);
+		if (j) {
+			zblock_feed_info_minimal updated_feed = *sub;
+			updated_feed.last_pubDate = items[0].pubDate;
+			if (zblock_feed_info_batch_update(batch, &updated_feed)) {
+				log_error("Unable to save the last pubDate of %s", sub->url);
+			}
+		}
+	}
+}
+
+// returns the shortest poll interval a feed asked for through <ttl> or sy:updatePeriod
+static int feed_min_interval(zblock_feed_parser *parser) {
+	long ttl = strtol(parser->ttl, NULL, 10);
+	int min_interval = ttl > 0 && ttl < ZBLOCK_SCHEDULE_MAX_INTERVAL / 60 ? ttl * 60 : ttl > 0 ? ZBLOCK_SCHEDULE_MAX_INTERVAL : 0;
+	
+	int sy_interval = zblock_schedule_sy_interval(*parser->update_period ? parser->update_period : NULL, *parser->update_frequency ? parser->update_frequency : NULL);
+	if (sy_interval > min_interval) min_interval = sy_interval;
+	
+	return min_interval;
+}
+
+// decides when a feed should be polled again and saves it
+static void feed_buffer_schedule(zblock_feed_info_batch *batch, zblock_feed_buffer *feed_buffer, zblock_schedule_result result) {
+	int min_interval = feed_buffer->max_age;
+	if (result == ZBLOCK_SCHEDULE_UPDATED) {
+		int feed_interval = feed_min_interval(&feed_buffer->parser);
+		if (feed_interval > min_interval) min_interval = feed_interval;
+	}
+	
+	int poll_interval = zblock_schedule_next_interval(
+		feed_buffer->subs[0].poll_interval, result,
+		feed_buffer->item_dates, feed_buffer->ndates,
+		min_interval, time(NULL)
+	);
+	if (zblock_feed_info_batch_update_schedule(batch, feed_buffer->subs[0].url, poll_interval)) {
+		log_error("Unable to schedule the next poll of %s", feed_buffer->subs[0].url);
+	}
+}
+
+// runs one cycle, retrieving every feed that is due
+static void retrieve_feeds(void) {
+	CURLM *multi = poller.multi;
+	uint64_t cycle_start = zblock_metrics_now();
+	
+	// the connection is kept for the whole cycle since the list scan and update batches are tied to it
+	PGconn *database_conn = zblock_db_pool_checkout();
+	if (!database_conn) {
+		log_error("Unable to retrieve feed list: No database connection");
+		return;
+	}
+	
+	zblock_admission *admission = zblock_admission_new(zblock_config.max_connections, zblock_config.max_host_connections);
+	if (!admission) {
+		log_error("Unable to retrieve feed list: %s", strerror(errno));
+		zblock_db_pool_checkin(database_conn);
+		return;
+	}
+	
+	// nothing is recorded unless there's a file to write it to
+	if (zblock_config.trace_file) zblock_trace_begin(cycle_start);
+	
+	// Begin retrieval of feed list objects. the whole scan counts as one query.
+	uint64_t list_start = zblock_metrics_now();
+	if (zblock_feed_info_retrieve_list_begin(database_conn)) {
+		log_error("Unable to retrieve feed list: %s", PQerrorMessage(database_conn));
+		zblock_admission_delete(admission);
+		zblock_db_pool_checkin(database_conn);
+		zblock_trace_end(zblock_metrics_now(), zblock_config.trace_file, UINT64_MAX);
+		return;
+	}
+	
+	int running_handles, total_feeds = 0, total_subs = 0;
+	// downloads that were started and haven't been read back yet. one can finish before curl says it's running, so running_handles can't be trusted for this.
+	int active = 0;
+	// rows come back grouped by url, so every subscription to a feed is collected before it is downloaded
+	zblock_feed_buffer *feed_buffer = NULL;
+	zblock_feed_info_minimal feed_info;
+	while (!zblock_feed_info_retrieve_list_item(database_conn, &feed_info)) {
+		++total_subs;
+		if (feed_buffer && strcmp(feed_buffer->subs[0].url, feed_info.url)) {
+			// start transfers now instead of later
+			feed_buffer_queue(admission, feed_buffer);
+			active += admit_feeds(admission, multi);
+			feed_buffer = NULL;
+		}
+		
+		if (!feed_buffer) {
+			++total_feeds;
+			feed_buffer = calloc(1, sizeof(*feed_buffer));
+			if (!feed_buffer) {
+				log_error("Failure allocating feed buffer: %s", strerror(errno));
+				zblock_feed_info_minimal_free(&feed_info);
+				continue;
+			}
+			feed_buffer->track = total_feeds;
+		}
+		
+		if (!feed_buffer_add_sub(feed_buffer, &feed_info)) {
+			log_error("Failure allocating feed buffer: %s", strerror(errno));
+			zblock_feed_info_minimal_free(&feed_info);
+			if (!feed_buffer->nsubs) {
+				feed_buffer_free(feed_buffer);
+				feed_buffer = NULL;
+			}
+		}
+	}
+	uint64_t list_end = zblock_metrics_now();
+	zblock_metrics_observe(ZBLOCK_METRIC_DB_QUERY_DURATION, list_end - list_start);
+	zblock_trace_span("list scan", 0, list_start, list_end);
+	if (feed_buffer) feed_buffer_queue(admission, feed_buffer);
+	active += admit_feeds(admission, multi);
+	
+	// every write from this cycle goes out in batches once the feed list has been read
+	zblock_feed_info_batch *batch = zblock_feed_info_batch_new(database_conn, POLLER_BATCH_SIZE);
+	if (!batch) log_error("Unable to create update batch: %s", strerror(errno));
+	
+	// new items are held until the end of the cycle so each channel gets as few messages as possible
+	zblock_message_batch *messages = zblock_message_batch_new();
+	if (!messages) log_error("Unable to create message batch: %s", strerror(errno));
+	
+	int successful_feeds = 0;
+	// it's time
+	do {
+		CURLMcode mc = curl_multi_perform(multi, &running_handles);
+		CURLMsg *msg;
+		int msgs_in_queue;
+		do {
+			msg = curl_multi_info_read(multi, &msgs_in_queue);
+			if (msg && msg->msg == CURLMSG_DONE) {
+				CURL *handle = msg->easy_handle;
+				// get our buffer out
+				zblock_feed_buffer *feed_buffer;
+				curl_easy_getinfo(handle, CURLINFO_PRIVATE, &feed_buffer);
+				long response_code = 0;
+				curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &response_code);
+				// the transfer is cut short on purpose once the parser has found everything new or the body turns out to be the same
+				CURLcode result = msg->data.result;
+				if (result == CURLE_WRITE_ERROR && (feed_buffer->parser.stopped || feed_buffer->unchanged)) result = CURLE_OK;
+				// bodies shorter than the prefix are only hashed once they're complete
+				if (!result && response_code < 300 && !feed_buffer->content_hash) feed_buffer_finish_prefix(feed_buffer);
+				feed_buffer_count(handle, result, response_code);
+				uint64_t done_at = trace_now();
+				const char *outcome; // for the trace
+				if (!result && response_code == 304) {
+					// nothing has changed since the last time we asked
+					outcome = "not modified";
+					++successful_feeds;
+					feed_buffer_schedule(batch, feed_buffer, ZBLOCK_SCHEDULE_NOT_MODIFIED);
+				} else if (!result && response_code >= 300) {
+					log_error("Error downloading RSS feed at %s: HTTP status %ld\n", feed_buffer->subs[0].url, response_code);
+					outcome = "http error";
+					feed_buffer_schedule(batch, feed_buffer, ZBLOCK_SCHEDULE_FAILED);
+				} else if (!result && feed_buffer->unchanged) {
+					// the server sent the same thing again, so there is nothing to parse or save
+					outcome = "unchanged";
+					++successful_feeds;
+					feed_buffer_schedule(batch, feed_buffer, ZBLOCK_SCHEDULE_NOT_MODIFIED);
+				} else if (!result) {
+					// the feed has already been parsed, make sure it was actually a feed
+					uint64_t finish_start = zblock_metrics_now();
+					zblock_feed_parser_err parser_err = zblock_feed_parser_finish(&feed_buffer->parser);
+					feed_buffer->parse_usec += zblock_metrics_now() - finish_start;
+					zblock_metrics_observe(ZBLOCK_METRIC_PARSE_DURATION, feed_buffer->parse_usec);
+					if (parser_err == ZBLOCK_FEED_PARSER_OK || parser_err == ZBLOCK_FEED_PARSER_STOPPED) {
+						outcome = "updated";
+						++successful_feeds;
+						// send any new entries
+						uint64_t send_start = trace_now();
+						feed_buffer_send(messages, batch, feed_buffer);
+						zblock_trace_span("send", feed_buffer->track, send_start, trace_now());
+						
+						// remember the validators for the next request
+						if (!str_equal_nullable(feed_buffer->etag, feed_buffer->subs[0].etag)
+							|| !str_equal_nullable(feed_buffer->last_modified, feed_buffer->subs[0].last_modified)) {
+							zblock_feed_info_batch_update_cache(batch, feed_buffer->subs[0].url, feed_buffer->etag, feed_buffer->last_modified);
+						}
+						if (feed_buffer->content_hash != feed_buffer->known_hash) {
+							zblock_feed_info_batch_update_hash(batch, feed_buffer->subs[0].url, feed_buffer->content_hash);
+						}
+						feed_buffer_schedule(batch, feed_buffer, ZBLOCK_SCHEDULE_UPDATED);
+					} else {
+						log_error("Error parsing feed at %s: %s\n", feed_buffer->subs[0].url, zblock_feed_parser_strerror(parser_err));
+						outcome = "parse error";
+						feed_buffer_schedule(batch, feed_buffer, ZBLOCK_SCHEDULE_FAILED);
+					}
+				} else {
+					log_error("Error downloading RSS feed at %s: %s\n", feed_buffer->subs[0].url, curl_easy_strerror(result));
+					outcome = "fetch error";
+					feed_buffer_schedule(batch, feed_buffer, ZBLOCK_SCHEDULE_FAILED);
+				}
+				
+				if (done_at) feed_buffer_trace(handle, feed_buffer, response_code, outcome, done_at);
+				
+				// free our buffers
+				curl_multi_remove_handle(multi, handle);
+				curl_easy_cleanup(handle);
+				zblock_admission_done(admission, feed_buffer->host);
+				feed_buffer_free(feed_buffer);
+				--active;
+			}
+		} while (msg);
+		
+		// fill the slots that just opened up
+		active += admit_feeds(admission, multi);
+		if (!mc) mc = curl_multi_perform(multi, &running_handles);
+		
+		if (!mc && running_handles) {
+			mc = curl_multi_poll(multi, NULL, 0, 300, NULL);
+		}
+		if (mc) {
+			// figure out how to free all resources instead of crashing
+			log_fatal("curl_multi_poll(): %s", curl_multi_strerror(mc));
+			exit(1);
+		}
+	} while (active || zblock_admission_pending(admission));
+	
+	zblock_admission_delete(admission);
+	uint64_t downloads_end = trace_now();
+	zblock_trace_span("downloads", 0, list_end, downloads_end);
+	
+	if (messages) zblock_message_batch_send(messages);
+	zblock_message_batch_delete(messages);
+	uint64_t post_end = trace_now();
+	zblock_trace_span("post", 0, downloads_end, post_end);
+	
+	if (batch && zblock_feed_info_batch_flush(batch)) log_error("Unable to save feed updates");
+	zblock_feed_info_batch_delete(batch);
+	zblock_db_pool_checkin(database_conn);
+	
+	// processing is done, the multi handle is kept for the next cycle
+	if (total_feeds) log_info("Retrieved %d of %d feeds for %d subscriptions!", successful_feeds, total_feeds, total_subs);
+	uint64_t cycle_end = zblock_metrics_now();
+	zblock_trace_span("save", 0, post_end, cycle_end);
+	zblock_metrics_observe(ZBLOCK_METRIC_CYCLE_DURATION, cycle_end - cycle_start);
+	
+	if (zblock_trace_recording()) {
+		zblock_trace_span("cycle", 0, cycle_start, cycle_end);
+		zblock_trace_err trace_err = zblock_trace_end(cycle_end, zblock_config.trace_file, zblock_config.trace_min_cycle_ms * 1000ULL);
+		if (trace_err) log_warn("%s %s: %s", zblock_trace_strerror(trace_err), zblock_config.trace_file, strerror(errno));
+	}
+}
+
+static void *thread_poller(void *arg) {
+	(void) arg;
+	
+	pthread_mutex_lock(&poller.lock);
+	for (;;) {
+		while (!poller.wakeup && !poller.stop) pthread_cond_wait(&poller.cond, &poller.lock);
+		if (poller.stop) break;
+		// requests made while a cycle is running are folded into the next one
+		poller.wakeup = false;
+		pthread_mutex_unlock(&poller.lock);
+		
+		retrieve_feeds();
+		
+		pthread_mutex_lock(&poller.lock);
+	}
+	pthread_mutex_unlock(&poller.lock);
+	
+	return NULL;
+}
+
+// starts the poller thread. feeds are not retrieved until zblock_poller_signal is called.
+zblock_poller_err zblock_poller_start(void) {
+	if (poller.running) return ZBLOCK_POLLER_RUNNING;
+	
+	poller.multi = curl_multi_init();
+	if (!poller.multi) return ZBLOCK_POLLER_CURL_ERROR;
+	
+	poller.wakeup = false;
+	poller.stop = false;
+	if (pthread_create(&poller.thread, NULL, &thread_poller, NULL)) {
+		curl_multi_cleanup(poller.multi);
+		return ZBLOCK_POLLER_THREAD_ERROR;
+	}
+	
+	poller.running = true;
+	return ZBLOCK_POLLER_OK;
+}
+
+// wakes up the poller to retrieve every feed that is due. does nothing if a cycle is already waiting to run.
+void zblock_poller_signal(void) {
+	pthread_mutex_lock(&poller.lock);
+	poller.wakeup = true;
+	pthread_cond_signal(&poller.cond);
+	pthread_mutex_unlock(&poller.lock);
+}
+
+// waits for the current cycle to finish and stops the poller thread
+void zblock_poller_stop(void) {
+	if (!poller.running) return;
+	
+	pthread_mutex_lock(&poller.lock);
+	poller.stop = true;
+	pthread_cond_signal(&poller.cond);
+	pthread_mutex_unlock(&poller.lock);
+	
+	pthread_join(poller.thread, NULL);
+	curl_multi_cleanup(poller.multi);
+	poller.running = false;
+}
+
+// returns a string about the result of a poller function
+const char *zblock_poller_strerror(zblock_poller_err error) {
+	return error < 0 || error >= ZBLOCK_POLLER_ERRORCOUNT ? "Unspecified error" : ZBLOCK_POLLER_ERRORS[error];
+}
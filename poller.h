@@ -0,0 +1,24 @@
+#ifndef ZBLOCK_POLLER_H
+#define ZBLOCK_POLLER_H
+
+typedef enum {
+	ZBLOCK_POLLER_OK,
+	ZBLOCK_POLLER_RUNNING,
+	ZBLOCK_POLLER_CURL_ERROR,
+	ZBLOCK_POLLER_THREAD_ERROR,
+	ZBLOCK_POLLER_ERRORCOUNT
+} zblock_poller_err;
+
+// starts the poller thread. feeds are not retrieved until zblock_poller_signal is called.
+zblock_poller_err zblock_poller_start(void);
+
+// wakes up the poller to retrieve every feed that is due. does nothing if a cycle is already waiting to run.
+void zblock_poller_signal(void);
+
+// waits for the current cycle to finish and stops the poller thread
+void zblock_poller_stop(void);
+
+// returns a string about the result of a poller function
+const char *zblock_poller_strerror(zblock_poller_err error);
+
+#endif
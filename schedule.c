@@ -0,0 +1,100 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "schedule.h"
+
+static int clamp_interval(long interval) {
+	if (interval < ZBLOCK_SCHEDULE_MIN_INTERVAL) return ZBLOCK_SCHEDULE_MIN_INTERVAL;
+	if (interval > ZBLOCK_SCHEDULE_MAX_INTERVAL) return ZBLOCK_SCHEDULE_MAX_INTERVAL;
+	return interval;
+}
+
+/* Computes the number of seconds until a feed should be polled again.
+ * item_dates holds the publication dates of the newest items in the feed, newest first (only used when the feed was updated).
+ * min_interval is the shortest interval the feed asked for (ttl, sy:updatePeriod, Cache-Control), or 0 if it didn't ask. */
+int zblock_schedule_next_interval(int last_interval, zblock_schedule_result result, const time_t *item_dates, size_t ndates, int min_interval, time_t now) {
+	if (last_interval <= 0) last_interval = ZBLOCK_SCHEDULE_DEFAULT_INTERVAL;
+	
+	long interval;
+	switch (result) {
+		case ZBLOCK_SCHEDULE_UPDATED: {
+			// skip items without a valid date, they can't tell us anything
+			size_t first = 0, last = ndates;
+			while (first < last && !item_dates[first]) ++first;
+			while (last > first && !item_dates[last - 1]) --last;
+			if (first == last) {
+				// no dates to go off of, so back off slowly
+				interval = last_interval + last_interval / 2;
+				break;
+			}
+			
+			// average time between posts, or the time since the last post if that's longer (so dead feeds slow down)
+			long gap = last - first > 1 ? (item_dates[first] - item_dates[last - 1]) / (long) (last - first - 1) : 0;
+			long age = now - item_dates[first];
+			if (age > gap) gap = age;
+			// check a few times per post so new entries don't wait too long
+			interval = gap / 4;
+		} break;
+		case ZBLOCK_SCHEDULE_NOT_MODIFIED:
+			interval = last_interval + last_interval / 4;
+			break;
+		case ZBLOCK_SCHEDULE_FAILED:
+		default:
+			interval = last_interval * 2L;
+	}
+	
+	if (interval < min_interval) interval = min_interval;
+	return clamp_interval(interval);
+}
+
+// converts sy:updatePeriod and sy:updateFrequency into an interval in seconds. returns 0 if the period is invalid.
+int zblock_schedule_sy_interval(const char *update_period, const char *update_frequency) {
+	if (!update_period) return 0;
+	
+	static const struct {
+		const char *name;
+		long seconds;
+	} periods[] = {
+		{"hourly", 3600},
+		{"daily", 86400},
+		{"weekly", 604800},
+		{"monthly", 2592000},
+		{"yearly", 31536000}
+	};
+	
+	// surrounding whitespace is allowed in the element
+	update_period += strspn(update_period, " \t\r\n");
+	size_t period_len = strcspn(update_period, " \t\r\n");
+	for (size_t i = 0; i < sizeof(periods) / sizeof(*periods); ++i) {
+		if (period_len == strlen(periods[i].name) && !strncasecmp(update_period, periods[i].name, period_len)) {
+			long frequency = update_frequency ? strtol(update_frequency, NULL, 10) : 1;
+			if (frequency < 1) frequency = 1;
+			long interval = periods[i].seconds / frequency;
+			return interval > ZBLOCK_SCHEDULE_MAX_INTERVAL ? ZBLOCK_SCHEDULE_MAX_INTERVAL : interval;
+		}
+	}
+	
+	return 0;
+}
+
+// returns the max-age of a Cache-Control header value in seconds, or 0 if there is none.
+int zblock_schedule_max_age(const char *cache_control) {
+	if (!cache_control) return 0;
+	
+	const char *directive = cache_control;
+	while (*directive) {
+		directive += strspn(directive, " \t,");
+		if (!strncasecmp(directive, "max-age=", 8)) {
+			long max_age = strtol(directive + 8, NULL, 10);
+			if (max_age < 0) return 0;
+			return max_age > ZBLOCK_SCHEDULE_MAX_INTERVAL ? ZBLOCK_SCHEDULE_MAX_INTERVAL : max_age;
+		}
+		directive += strcspn(directive, ",");
+	}
+	
+	return 0;
+}
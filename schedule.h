@@ -0,0 +1,36 @@
+#ifndef ZBLOCK_SCHEDULE_H
+#define ZBLOCK_SCHEDULE_H
+
+#include <stddef.h>
+#include <time.h>
+
+// shortest time between polls of a feed (in seconds)
+#define ZBLOCK_SCHEDULE_MIN_INTERVAL 300
+
+// longest time between polls of a feed (in seconds)
+#define ZBLOCK_SCHEDULE_MAX_INTERVAL 86400
+
+// interval used for feeds that have never been polled (in seconds)
+#define ZBLOCK_SCHEDULE_DEFAULT_INTERVAL 600
+
+// how many of the newest items are used to estimate how often a feed publishes
+#define ZBLOCK_SCHEDULE_SAMPLE_SIZE 10
+
+typedef enum {
+	ZBLOCK_SCHEDULE_UPDATED, // the feed was downloaded and parsed
+	ZBLOCK_SCHEDULE_NOT_MODIFIED, // the server told us nothing has changed
+	ZBLOCK_SCHEDULE_FAILED // the feed could not be downloaded or parsed
+} zblock_schedule_result;
+
+/* Computes the number of seconds until a feed should be polled again.
+ * item_dates holds the publication dates of the newest items in the feed, newest first (only used when the feed was updated).
+ * min_interval is the shortest interval the feed asked for (ttl, sy:updatePeriod, Cache-Control), or 0 if it didn't ask. */
+int zblock_schedule_next_interval(int last_interval, zblock_schedule_result result, const time_t *item_dates, size_t ndates, int min_interval, time_t now);
+
+// converts sy:updatePeriod and sy:updateFrequency into an interval in seconds. returns 0 if the period is invalid.
+int zblock_schedule_sy_interval(const char *update_period, const char *update_frequency);
+
+// returns the max-age of a Cache-Control header value in seconds, or 0 if there is none.
+int zblock_schedule_max_age(const char *cache_control);
+
+#endif
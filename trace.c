@@ -0,0 +1,178 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+static const char *ZBLOCK_TRACE_ERRORS[] = {
+	"OK",
+	"No cycle is being traced",
+	"Unable to write the trace file"
+};
+static_assert(sizeof(ZBLOCK_TRACE_ERRORS) / sizeof(*ZBLOCK_TRACE_ERRORS) == ZBLOCK_TRACE_ERRORCOUNT, "Not all trace errors implemented");
+
+struct trace_event {
+	const char *name;
+	uint32_t track;
+	uint64_t start, end;
+	char *url; // only set on feed spans
+	char *args;
+};
+
+// only ever touched by the poller thread, so there is nothing to lock
+static struct {
+	bool recording;
+	uint64_t start;
+	struct trace_event *events;
+	size_t nevents;
+	size_t capacity;
+	size_t dropped; // events that didn't fit because memory ran out
+} trace;
+
+static void events_free(void) {
+	for (size_t i = 0; i < trace.nevents; ++i) {
+		free(trace.events[i].url);
+		free(trace.events[i].args);
+	}
+	free(trace.events);
+	trace.events = NULL;
+	trace.nevents = trace.capacity = 0;
+	trace.dropped = 0;
+}
+
+// makes room for one more event. returns NULL and counts it as dropped if out of memory.
+static struct trace_event *event_push(void) {
+	if (trace.nevents == trace.capacity) {
+		size_t new_capacity = trace.capacity ? trace.capacity * 2 : 256;
+		struct trace_event *new_events = realloc(trace.events, new_capacity * sizeof(*new_events));
+		if (!new_events) {
+			++trace.dropped;
+			return NULL;
+		}
+		trace.events = new_events;
+		trace.capacity = new_capacity;
+	}
+	return &trace.events[trace.nevents++];
+}
+
+// starts recording a cycle. timestamps are from zblock_metrics_now.
+void zblock_trace_begin(uint64_t start) {
+	events_free();
+	trace.start = start;
+	trace.recording = true;
+}
+
+// true between zblock_trace_begin and zblock_trace_end. everything else does nothing when this is false.
+bool zblock_trace_recording(void) {
+	return trace.recording;
+}
+
+// records a span on a track. name has to outlive the cycle, so it should be a literal.
+void zblock_trace_span(const char *name, uint32_t track, uint64_t start, uint64_t end) {
+	if (!trace.recording) return;
+	struct trace_event *event = event_push();
+	if (!event) return;
+	*event = (struct trace_event) {
+		.name = name,
+		.track = track,
+		.start = start,
+		.end = end
+	};
+}
+
+/* Records the span of a whole feed and names its track after the url.
+ * args is a JSON object that is shown with the span, or NULL. */
+void zblock_trace_feed(uint32_t track, const char *url, uint64_t start, uint64_t end, const char *args) {
+	if (!trace.recording) return;
+	struct trace_event *event = event_push();
+	if (!event) return;
+	*event = (struct trace_event) {
+		.name = "feed",
+		.track = track,
+		.start = start,
+		.end = end,
+		.url = strdup(url),
+		.args = args ? strdup(args) : NULL
+	};
+}
+
+// writes a string as a JSON string
+static void write_json_string(FILE *file, const char *str) {
+	fputc('"', file);
+	for (const unsigned char *c = (const unsigned char *) str; *c; ++c) {
+		if (*c == '"' || *c == '\\') fprintf(file, "\\%c", *c);
+		else if (*c < 0x20) fprintf(file, "\\u%04x", *c);
+		else fputc(*c, file);
+	}
+	fputc('"', file);
+}
+
+static void write_event(FILE *file, const struct trace_event *event) {
+	// spans can start a little before the cycle does if they were timed before it began
+	uint64_t ts = event->start > trace.start ? event->start - trace.start : 0;
+	uint64_t dur = event->end > event->start ? event->end - event->start : 0;
+	fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%" PRIu32 ",\"ts\":%" PRIu64 ",\"dur\":%" PRIu64, event->name, event->track, ts, dur);
+	if (event->url) {
+		fputs(",\"args\":{\"url\":", file);
+		write_json_string(file, event->url);
+		// args is already an object, so its members are spliced in after the url
+		if (event->args && event->args[0] == '{' && event->args[1] != '}') fprintf(file, ",%s", event->args + 1);
+		else fputc('}', file);
+	} else if (event->args) {
+		fprintf(file, ",\"args\":%s", event->args);
+	}
+	fputs("}", file);
+
+	// feeds get their track named after them
+	if (event->url) {
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%" PRIu32 ",\"args\":{\"name\":", event->track);
+		write_json_string(file, event->url);
+		fputs("}}", file);
+	}
+}
+
+/* Stops recording. The trace is written to path if the cycle took at least min_duration (in microseconds),
+ * replacing the trace of an earlier cycle. */
+zblock_trace_err zblock_trace_end(uint64_t end, const char *path, uint64_t min_duration) {
+	if (!trace.recording) return ZBLOCK_TRACE_NOT_RECORDING;
+	trace.recording = false;
+	if (end - trace.start < min_duration) {
+		events_free();
+		return ZBLOCK_TRACE_OK;
+	}
+
+	// written next to path and renamed over it so a half written trace never replaces a good one
+	size_t tmp_size = strlen(path) + sizeof(".tmp");
+	char *tmp_path = malloc(tmp_size);
+	FILE *file = tmp_path && snprintf(tmp_path, tmp_size, "%s.tmp", path) > 0 ? fopen(tmp_path, "w") : NULL;
+	if (!file) {
+		free(tmp_path);
+		events_free();
+		return ZBLOCK_TRACE_FILE_ERROR;
+	}
+
+	fputs("{\"traceEvents\":[\n", file);
+	fputs("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"cycle\"}}", file);
+	for (size_t i = 0; i < trace.nevents; ++i) {
+		fputs(",\n", file);
+		write_event(file, &trace.events[i]);
+	}
+	fprintf(file, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":%zu}}\n", trace.dropped);
+
+	bool ok = !ferror(file);
+	if (fclose(file)) ok = false;
+	if (ok && rename(tmp_path, path)) ok = false;
+	if (!ok) remove(tmp_path);
+	free(tmp_path);
+	events_free();
+	return ok ? ZBLOCK_TRACE_OK : ZBLOCK_TRACE_FILE_ERROR;
+}
+
+// returns a string about the result of a trace function
+const char *zblock_trace_strerror(zblock_trace_err error) {
+	return error < 0 || error >= ZBLOCK_TRACE_ERRORCOUNT ? "Unspecified error" : ZBLOCK_TRACE_ERRORS[error];
+}
@@ -0,0 +1,38 @@
+#ifndef ZBLOCK_TRACE_H
+#define ZBLOCK_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Records where a poll cycle spent its time and writes it out as Chrome trace-event JSON,
+ * which chrome://tracing, Perfetto and speedscope can all open.
+ * The cycle is on track 0 and every feed gets a track of its own. Only the poller thread traces. */
+
+typedef enum {
+	ZBLOCK_TRACE_OK,
+	ZBLOCK_TRACE_NOT_RECORDING,
+	ZBLOCK_TRACE_FILE_ERROR,
+	ZBLOCK_TRACE_ERRORCOUNT
+} zblock_trace_err;
+
+// starts recording a cycle. timestamps are from zblock_metrics_now.
+void zblock_trace_begin(uint64_t start);
+
+// true between zblock_trace_begin and zblock_trace_end. everything else does nothing when this is false.
+bool zblock_trace_recording(void);
+
+// records a span on a track. name has to outlive the cycle, so it should be a literal.
+void zblock_trace_span(const char *name, uint32_t track, uint64_t start, uint64_t end);
+
+/* Records the span of a whole feed and names its track after the url.
+ * args is a JSON object that is shown with the span, or NULL. */
+void zblock_trace_feed(uint32_t track, const char *url, uint64_t start, uint64_t end, const char *args);
+
+/* Stops recording. The trace is written to path if the cycle took at least min_duration (in microseconds),
+ * replacing the trace of an earlier cycle. */
+zblock_trace_err zblock_trace_end(uint64_t end, const char *path, uint64_t min_duration);
+
+// returns a string about the result of a trace function
+const char *zblock_trace_strerror(zblock_trace_err error);
+
+#endif